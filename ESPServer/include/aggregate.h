@@ -0,0 +1,76 @@
+/*
+
+Telemetry aggregation. The telemetry loop adds every control-rate sample to a
+window that tracks min, max, mean and RMS per field, so clients that poll at
+a few hertz still see spikes and oscillations between their polls. Windows
+can be merged without losing anything, which lets the socket task combine
+every window closed since the client last asked.
+
+No Arduino dependencies.
+
+*/
+
+#ifndef AGGREGATE
+
+#define AGGREGATE
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief the fields aggregated at the control rate
+enum AggregateField {
+  AggregateTilt = 0,        // degrees
+  AggregateTiltRate = 1,    // degrees per second
+  AggregateMotorTarget = 2, // rad/s
+  AggregateIntegralSum = 3,
+  AggregateFieldCount,
+};
+
+#define AGGREGATE_HEADER_LENGTH 12
+#define AGGREGATE_FIELD_LENGTH 16
+#define TELEMETRY_SUMMARY_LENGTH (AGGREGATE_HEADER_LENGTH + AggregateFieldCount * AGGREGATE_FIELD_LENGTH)
+
+/// @brief running statistics for one field. The sums are double: the
+/// integral's square is ~1e4 per sample, so a float sum of squares passes
+/// 2^24 within a couple of thousand samples and every later sample is
+/// rounded as the window grows
+struct FieldAggregate {
+  float min;
+  float max;
+  double sum;
+  double sum_squares;
+};
+
+/// @brief the statistics of every field over a span of samples
+struct TelemetryWindow {
+  uint32_t start_micros;
+  uint32_t end_micros;
+  uint32_t samples;
+  FieldAggregate fields[AggregateFieldCount];
+};
+
+/// @brief one field of a decoded summary
+struct FieldSummary {
+  float min;
+  float max;
+  float mean;
+  float rms;
+};
+
+/// @brief a window as reported to the client
+struct TelemetrySummary {
+  uint32_t start_micros;
+  uint32_t end_micros;
+  uint32_t samples;
+  FieldSummary fields[AggregateFieldCount];
+};
+
+void window_reset(TelemetryWindow *window);
+void window_add(TelemetryWindow *window, const float values[AggregateFieldCount], uint32_t now);
+void window_merge(TelemetryWindow *into, const TelemetryWindow *from);
+void window_summarise(const TelemetryWindow *window, TelemetrySummary *summary);
+
+size_t encode_telemetry_summary(const TelemetrySummary *summary, uint8_t *out);
+bool decode_telemetry_summary(const uint8_t *data, size_t length, TelemetrySummary *summary);
+
+#endif
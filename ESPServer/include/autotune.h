@@ -0,0 +1,94 @@
+/*
+
+Relay-feedback (Astrom-Hagglund) PID autotuner. While running, it replaces
+the PID output with a bang-bang relay on the tilt error, which drives the
+robot into a limit cycle. The amplitude and period of that cycle give the
+ultimate gain and period, from which Ziegler-Nichols gains are computed.
+
+No Arduino dependencies; telemetry_loop feeds it one sample per iteration.
+
+*/
+
+#ifndef AUTOTUNE
+
+#define AUTOTUNE
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define AUTOTUNE_SETTLE_CYCLES 2  // cycles ignored while the oscillation builds
+#define AUTOTUNE_MEASURE_CYCLES 4 // cycles averaged for the result
+#define AUTOTUNE_STATUS_LENGTH 29
+
+enum AutotuneState {
+  AutotuneIdle = 0,
+  AutotuneRunning = 1,
+  AutotuneDone = 2,
+  AutotuneAborted = 3,
+};
+
+enum AutotuneAbort {
+  AbortNone = 0,
+  AbortTilt = 1,          // tilt exceeded the safety limit
+  AbortTimeout = 2,       // no stable oscillation in time
+  AbortCancelled = 3,     // cancelled by the client or motors disabled
+};
+
+struct Autotuner {
+  AutotuneState state;
+  AutotuneAbort abort_reason;
+
+  // experiment settings
+  float relay_amplitude; // motor output, rad/s
+  float hysteresis;      // tilt, degrees
+  float max_tilt;        // degrees
+  float timeout;         // seconds
+
+  // relay and cycle tracking
+  bool relay_high;
+  bool seen_switch;
+  float elapsed;
+  float last_rising_switch;
+  float cycle_max;
+  float cycle_min;
+  uint8_t cycles;
+  float period_sum;
+  float amplitude_sum;
+  float sample_time_sum;
+  uint32_t sample_count;
+
+  // results
+  float last_amplitude;
+  float last_period;
+  float ultimate_gain;
+  float ultimate_period;
+  float kp;
+  float ki;
+  float kd;
+  float mean_sample_time;
+};
+
+/// @brief progress and results, as streamed to the client; gains are in
+/// the units of PidState
+struct AutotuneStatus {
+  uint8_t state;
+  uint8_t abort_reason;
+  uint8_t cycles;
+  float elapsed;
+  float amplitude;
+  float period;
+  float ultimate_gain;
+  float ultimate_period;
+  int16_t proportional;
+  int16_t integral;
+  int16_t derivative;
+};
+
+void autotune_start(Autotuner *tuner, float relay_amplitude, float hysteresis, float max_tilt, float timeout);
+void autotune_cancel(Autotuner *tuner);
+float autotune_step(Autotuner *tuner, float error, float delta_time);
+
+size_t encode_autotune_status(const AutotuneStatus *status, uint8_t *out);
+bool decode_autotune_status(const uint8_t *data, size_t length, AutotuneStatus *status);
+
+#endif
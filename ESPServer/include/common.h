@@ -6,25 +6,24 @@
 
 #include <Arduino.h>
 #include "datamodel.h"
+#include "protocol.h"
+#include "profile.h"
 
 // socket server settings
 #define DEBUG
 #define PASSWORD "franklin44"
 #define SSID_NAME "franklin"
 #define SERVER_PORT 80
-#define HEADER_BYTE 0x46
 #define REQUEST_TIMEOUT_MILLIS 5000
 
-// GPIO pinouts
-#define DIR_PIN_1 23
-#define DIR_PIN_2 32
-#define STEP_PIN_1 15
-#define STEP_PIN_2 33
-#define AUX_POWER_1 18
-
-// stepper settings
-#define STEPS_PER_REV 3200
-#define MAX_ANGULAR_VELOCITY 50
+// memory settings
+#ifndef DYNAMIC_MEMORY
+#define STATIC_MEMORY // pre-allocate tasks, queues and payload buffers
+#endif
+#define WEBSOCKET_STACK_SIZE 4096 // bytes
+#define TELEMETRY_STACK_SIZE 2048
+#define STEPPER_STACK_SIZE 4096
+#define PAYLOAD_POOL_BLOCKS 2 // each MAX_PAYLOAD_LENGTH bytes
 
 // I2C config
 #define MPU_I2C_ADDR 0x68
@@ -34,16 +33,24 @@
 #define ROT_VARIANCE_GYRO 4
 #define ROT_VARIANCE_ACCEL 3
 
-#define ALPHA 0.125
 #define GYRO_POLL_DELAY 25
+#define FILTER_SAMPLE_RATE (1000.0 / GYRO_POLL_DELAY) // Hz; nominal loop rate, before the loop body time
+#define FILTER_RATE_SMOOTHING 0.05 // weight of each loop in the measured rate filters are designed at
 
-#define KYLE_CONSTANT 0.8
+#define AUTOTUNE_HYSTERESIS 0.5 // degrees
+#define AUTOTUNE_MAX_TILT 20    // degrees; the experiment aborts beyond this
+#define AUTOTUNE_TIMEOUT 30     // seconds
 
-#define PROPORTIONAL_SCALE 200 // ^-1
-#define INTEGRAL_SCALE 50
-#define DERIVATIVE_SCALE -200
+#define AGGREGATE_WINDOW_SAMPLES 4 // control-rate samples per published telemetry window
 
-#define MAXIMUM_INTEGRAL 100
+// control-link watchdog; idle until the client arms it. See link.h
+#define LINK_DEGRADED_SILENCE 500       // ms without a request
+#define LINK_HOLD_SILENCE 1000          // ms
+#define LINK_LOST_SILENCE 3000          // ms
+#define LINK_DEGRADED_ROUND_TRIP 100000 // us, smoothed
+#define LINK_HOLD_ROUND_TRIP 300000     // us, smoothed
+#define LINK_RECOVERY_TIME 1000         // ms a better state must hold before it is entered
+#define LINK_TELEMETRY_DIVISOR 4        // while degraded, telemetry is published and polled n times less often
 
 // debug logging functions
 #define DEBUG
@@ -55,9 +62,28 @@
 #define debug_println(message)
 #endif
 
-// cross-task queues
+// cross-task queues and their lengths, shared with the host load generator
+#define SOCK_TO_MOTION_LENGTH 10
+#define MOTOR_UPDATE_LENGTH 10
+#define MOTION_TO_SOCK_LENGTH 1
+#define TRACE_TO_SOCK_LENGTH 1
+#define AUTOTUNE_TO_SOCK_LENGTH 1
+#define SUMMARY_TO_SOCK_LENGTH 1
+#define LINK_TO_MOTION_LENGTH 1
+#define LINK_TO_SOCK_LENGTH 1
+
 extern QueueHandle_t sock_to_motion_queue;
 extern QueueHandle_t motor_update_queue;
 extern QueueHandle_t motion_to_sock_queue;
+extern QueueHandle_t trace_to_sock_queue;
+extern QueueHandle_t autotune_to_sock_queue;
+extern QueueHandle_t summary_to_sock_queue;
+extern QueueHandle_t link_to_motion_queue;
+extern QueueHandle_t link_to_sock_queue;
+
+// task handles, kept for stack telemetry
+extern TaskHandle_t websocket_task;
+extern TaskHandle_t telemetry_task;
+extern TaskHandle_t stepper_task;
 
 #endif
@@ -0,0 +1,141 @@
+/*
+
+Balance controllers. telemetry_loop talks to whichever controller is
+active through the Controller interface, so they can be switched at runtime
+with the ControllerMode update target.
+
+No Arduino dependencies, so controllers can be driven side by side on a
+host with identical inputs.
+
+*/
+
+#ifndef CONTROLLER
+
+#define CONTROLLER
+
+#include <stdint.h>
+
+enum ControllerMode {
+  ControllerPid = 0,
+  ControllerLqr = 1,
+};
+
+/// @brief everything a controller may use on one iteration
+struct ControllerInput {
+  double tilt;            // degrees from upright
+  double tilt_rate;       // degrees/s
+  double wheel_position;  // rad, integrated from the commanded wheel velocity
+  double wheel_velocity;  // rad/s, the command sent on the previous iteration
+  double velocity_target; // rad/s
+  double delta_time;      // seconds
+};
+
+/// @brief computes a wheel angular velocity from the robot's state
+class Controller {
+ public:
+  virtual ~Controller() {}
+
+  /// @brief runs one iteration of the controller
+  /// @return the angular velocity target for the motors, in rad/s
+  virtual double update(const ControllerInput &input) = 0;
+
+  /// @brief clears history so control resumes without a jump; called when
+  /// the controller is selected and when the motors are enabled
+  virtual void reset(const ControllerInput &input) = 0;
+};
+
+/// @brief the original SISO PID on tilt error. Gains are in the client's
+/// integer units and divided by the profile's scales; they are read through
+/// a pointer, so client updates apply on the next iteration
+/// @tparam Profile the robot profile supplying gain scales and limits
+/// @tparam Gains a struct with int16_t proportional, integral and derivative
+template <typename Profile, typename Gains>
+class PidController : public Controller {
+ public:
+  explicit PidController(const Gains *gains) : gains(gains) {}
+
+  double update(const ControllerInput &input) override {
+    double error = input.tilt;
+    double delta_time = input.delta_time;
+
+    double proportional = error;
+    integral += error / (delta_time * 100);
+    double derivative = (error - previous) / delta_time;
+    previous = error;
+
+    double output = (((double)gains->proportional / Profile::proportional_scale) * proportional) +
+                    (((double)gains->integral / Profile::integral_scale) * integral) +
+                    (((double)gains->derivative / Profile::derivative_scale) * derivative);
+
+    if (output >= Profile::max_angular_velocity) {
+      previous = 0;
+      output = Profile::max_angular_velocity;
+    } else if (output <= -Profile::max_angular_velocity) {
+      previous = 0;
+      output = -Profile::max_angular_velocity;
+    }
+
+    // wind-up is bounded after the output is computed
+    if (integral > Profile::maximum_integral) {
+      integral = Profile::maximum_integral;
+    } else if (integral < -Profile::maximum_integral) {
+      integral = -Profile::maximum_integral;
+    }
+
+    return output;
+  }
+
+  /// @brief zeroes the integral and seeds the derivative with the current
+  /// tilt. Before the controller interface the integral was never cleared;
+  /// it now is whenever the PID is selected and whenever the motors are
+  /// re-enabled, so the wind-up from before the motors were turned off does
+  /// not kick the robot when they come back on
+  void reset(const ControllerInput &input) override {
+    integral = 0;
+    previous = input.tilt;
+  }
+
+  double integral = 0; // read by telemetry
+  double previous = 0; // the tilt error of the previous iteration
+
+ private:
+  const Gains *gains;
+};
+
+/// @brief full state feedback over tilt, tilt rate, wheel position and wheel
+/// velocity. The steppers follow the commanded velocity, so the controller
+/// outputs a wheel acceleration and integrates it into that command. The
+/// velocity target is fed forward as a moving equilibrium: the wheel
+/// position reference ramps at the target and the velocity state is taken
+/// relative to it.
+/// @tparam Profile the robot profile supplying the precomputed gains
+template <typename Profile>
+class LqrController : public Controller {
+ public:
+  double update(const ControllerInput &input) override {
+    position_reference += input.velocity_target * input.delta_time;
+
+    double acceleration = -(Profile::lqr_k_tilt * input.tilt +
+                            Profile::lqr_k_tilt_rate * input.tilt_rate +
+                            Profile::lqr_k_position * (input.wheel_position - position_reference) +
+                            Profile::lqr_k_velocity * (input.wheel_velocity - input.velocity_target));
+
+    double output = input.wheel_velocity + acceleration * input.delta_time;
+
+    if (output > Profile::max_angular_velocity) {
+      output = Profile::max_angular_velocity;
+    } else if (output < -Profile::max_angular_velocity) {
+      output = -Profile::max_angular_velocity;
+    }
+    return output;
+  }
+
+  void reset(const ControllerInput &input) override {
+    position_reference = input.wheel_position;
+  }
+
+ private:
+  double position_reference = 0;
+};
+
+#endif
@@ -1,5 +1,9 @@
 #include <Arduino.h>
 #include "Wifi.h"
+#include "trace.h"
+#include "autotune.h"
+#include "aggregate.h"
+#include "link.h"
 
 enum UpdateTarget
 {
@@ -13,6 +17,13 @@ enum UpdateTarget
   GyroValue,
   MotorTargetOmega,
   IntegralSum,
+  FilterSelect,    // bank << 8 | stage; picks the stage the next three edit
+  FilterType,      // BiquadType
+  FilterFrequency, // in tenths of a hertz
+  FilterQuality,   // in hundredths
+  Autotune,        // relay amplitude in tenths of rad/s; zero cancels
+  ControllerSelect, // ControllerMode
+  LinkWatchdog,     // 1 arms the control-link watchdog, 0 disarms it
 };
 
 /// @brief passed to operation handlers; contains information about request
@@ -23,6 +34,7 @@ struct OperationRequest
   uint8_t *payload;
   uint16_t payload_length;
   WiFiClient *client;
+  uint64_t received_micros;
 };
 
 struct PidState
@@ -34,7 +46,7 @@ struct PidState
 
 struct KinematicState
 {
-  int16_t linear_velocity_target;
+  int16_t linear_velocity_target; // wheel velocity, hundredths of rad/s
   int16_t angular_velocity_target;
   bool motors_enabled;
   double gyro_offset;
@@ -51,12 +63,14 @@ struct MotionInfo
   double gyro_value;
   double motor_target;
   double integral_sum;
+  bool motors_enabled; // as applied by the motion task, after the link watchdog
 };
 
 typedef struct
 {
   int16_t value;
   UpdateTarget target;
+  CommandTrace trace;
 } ConfigQueueItem;
 
 typedef struct
@@ -67,4 +81,5 @@ typedef struct
 typedef struct
 {
   MotorTarget motor_target;
+  CommandTrace trace;
 } MotorQueueItem;
\ No newline at end of file
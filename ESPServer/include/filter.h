@@ -0,0 +1,75 @@
+/*
+
+Biquad filter banks for the IMU channels. Kernels run in float32, which the
+ESP32 FPU handles natively (double is emulated in software). No Arduino
+dependencies, so coefficients and responses can be checked on a host.
+
+Filters are designed at the rate they are sampled: the measured telemetry
+loop rate, which runs below the nominal 1000 / GYRO_POLL_DELAY because the
+loop body adds to the delay. Anything above its Nyquist frequency must still
+be removed by the MPU DLPF.
+
+*/
+
+#ifndef FILTER
+
+#define FILTER
+
+#include <stdint.h>
+
+#define BIQUAD_MAX_STAGES 4
+
+enum BiquadType {
+  BiquadNone = 0,
+  BiquadLowPass = 1,
+  BiquadNotch = 2,
+};
+
+/// @brief which bank a filter update applies to
+enum FilterBankId {
+  GyroFilterBank = 0,
+  AccelFilterBank = 1,
+};
+
+/// @brief normalised coefficients; a0 is divided out
+struct BiquadCoefficients {
+  float b0;
+  float b1;
+  float b2;
+  float a1;
+  float a2;
+};
+
+/// @brief transposed direct form II state for one channel of one stage
+struct BiquadState {
+  float z1;
+  float z2;
+  uint16_t generation; // the stage generation this state was primed for
+};
+
+/// @brief design parameters of one stage
+struct BiquadConfig {
+  BiquadType type;
+  float frequency; // Hz
+  float quality;
+};
+
+/// @brief a cascade of biquads shared by every axis of a sensor
+struct FilterBank {
+  float sample_rate; // Hz
+  uint8_t stage_count;
+  BiquadConfig config[BIQUAD_MAX_STAGES];
+  BiquadCoefficients coefficients[BIQUAD_MAX_STAGES];
+  uint16_t generation[BIQUAD_MAX_STAGES]; // bumped each time a stage is enabled
+};
+
+BiquadCoefficients design_biquad(BiquadConfig config, float sample_rate);
+float run_biquad(const BiquadCoefficients *coefficients, BiquadState *state, float input);
+void prime_biquad(const BiquadCoefficients *coefficients, BiquadState *state, float input);
+
+void filter_bank_init(FilterBank *bank, float sample_rate);
+bool filter_bank_configure(FilterBank *bank, uint8_t stage, BiquadConfig config);
+void filter_bank_set_rate(FilterBank *bank, float sample_rate);
+float filter_bank_run(const FilterBank *bank, BiquadState *states, float input);
+
+#endif
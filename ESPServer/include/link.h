@@ -0,0 +1,108 @@
+/*
+
+Control-link watchdog. The socket task reports every request it receives and
+the round trips measured by the client's heartbeats; the telemetry loop feeds
+those reports in and acts on the resulting state, so the watchdog keeps
+running even while the socket task is blocked on a stalled client.
+
+The response is staged as the link degrades:
+  LinkHealthy   normal operation
+  LinkDegraded  clients poll telemetry less often, going by the link state
+                in each heartbeat response, and the telemetry loop hands
+                it to the socket task less often
+  LinkHold      drive targets are zeroed; the robot keeps balancing
+  LinkLost      the motors are disabled, and stay off until the link is
+                healthy again and the client enables them
+
+A state worsens as soon as its threshold is crossed, and only improves once
+the better state has held for the recovery time. Every transition is kept
+with its timestamp. The watchdog is idle until a client arms it.
+
+No Arduino dependencies; times are passed in as milliseconds.
+
+*/
+
+#ifndef LINK
+
+#define LINK
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LINK_HISTORY_LENGTH 8
+#define LINK_TRANSITION_LENGTH 7
+#define LINK_STATUS_HEADER_LENGTH 15
+#define LINK_STATUS_LENGTH (LINK_STATUS_HEADER_LENGTH + LINK_HISTORY_LENGTH * LINK_TRANSITION_LENGTH)
+#define HEARTBEAT_REQUEST_LENGTH 6
+#define HEARTBEAT_RESPONSE_LENGTH 3
+
+enum LinkState {
+  LinkHealthy = 0,
+  LinkDegraded = 1,
+  LinkHold = 2,
+  LinkLost = 3,
+};
+
+/// @brief why a transition happened
+enum LinkCause {
+  LinkCauseSilence = 0,   // nothing heard from the client for too long
+  LinkCauseRoundTrip = 1, // the smoothed round trip crossed a threshold
+  LinkCauseRecovered = 2,
+  LinkCauseArmed = 3,
+  LinkCauseDisarmed = 4,
+};
+
+/// @brief the limits that move the link between states; silence and
+/// recovery in milliseconds, round trips in microseconds
+struct LinkThresholds {
+  uint32_t degraded_silence;
+  uint32_t hold_silence;
+  uint32_t lost_silence;
+  uint32_t degraded_round_trip;
+  uint32_t hold_round_trip;
+  uint32_t recovery_time;
+};
+
+struct LinkTransition {
+  uint32_t timestamp; // ms
+  uint8_t from;
+  uint8_t to;
+  uint8_t cause;
+};
+
+/// @brief sent from the socket task for every request it handles
+struct LinkReport {
+  uint32_t received_millis;
+  uint32_t round_trip; // us; the client's latest measurement, zero if none
+};
+
+/// @brief the drive state the staged response acts on
+struct LinkControls {
+  int16_t linear_velocity_target;
+  int16_t angular_velocity_target;
+  bool motors_enabled;
+};
+
+struct LinkMonitor {
+  LinkThresholds thresholds;
+  bool armed;
+  uint8_t state;
+  uint32_t last_heard;         // ms
+  float smoothed_round_trip;   // us
+  bool improving;
+  uint32_t improving_since;    // ms
+  uint32_t transition_count;
+  LinkTransition history[LINK_HISTORY_LENGTH]; // the latest transitions, by transition_count
+};
+
+void link_init(LinkMonitor *monitor, const LinkThresholds *thresholds);
+void link_arm(LinkMonitor *monitor, bool armed, uint32_t now);
+void link_report(LinkMonitor *monitor, const LinkReport *report);
+uint8_t link_update(LinkMonitor *monitor, uint32_t now);
+bool link_respond(const LinkMonitor *monitor, uint32_t loop_count, uint32_t telemetry_divisor,
+                  LinkControls *controls);
+bool link_allows_motors(const LinkMonitor *monitor);
+
+size_t encode_link_status(const LinkMonitor *monitor, uint32_t now, uint8_t *out);
+
+#endif
@@ -0,0 +1,53 @@
+/*
+
+Fixed-size buffer pool and memory telemetry. Used instead of malloc for
+request payloads when STATIC_MEMORY is defined, so long sessions cannot
+fragment the heap. No Arduino dependencies.
+
+A pool has no locking; it must only be used from a single task.
+
+*/
+
+#ifndef POOL
+
+#define POOL
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define POOL_MAX_BLOCKS 32
+#define MEMORY_STATS_LENGTH 40
+
+/// @brief a set of equally sized blocks carved from caller-owned storage
+struct BufferPool {
+  uint8_t *storage;
+  size_t block_size;
+  uint8_t block_count;
+  uint32_t used_mask;
+  uint8_t in_use;
+  uint8_t peak;
+  uint32_t failures;
+};
+
+/// @brief reported by the memory stats operation; stack figures are the
+/// minimum free stack each task has ever had, in bytes
+struct MemoryStats {
+  uint32_t websocket_stack_free;
+  uint32_t telemetry_stack_free;
+  uint32_t stepper_stack_free;
+  uint32_t heap_free;
+  uint32_t heap_minimum_free;
+  uint32_t heap_largest_block;
+  uint32_t pool_blocks;
+  uint32_t pool_in_use;
+  uint32_t pool_peak;
+  uint32_t pool_failures;
+};
+
+void pool_init(BufferPool *pool, uint8_t *storage, size_t block_size, uint8_t block_count);
+uint8_t *pool_alloc(BufferPool *pool, size_t length);
+void pool_free(BufferPool *pool, uint8_t *block);
+
+size_t encode_memory_stats(const MemoryStats *stats, uint8_t *out);
+
+#endif
@@ -0,0 +1,67 @@
+/*
+
+Compile-time robot profiles. Each chassis is a struct of constexpr
+constants; motion and stepper code is templated on the profile so every
+build is specialised with its constants folded in.
+
+To add a chassis, derive from an existing profile, override what differs,
+and add a selector below plus a PlatformIO environment that defines it. Give
+it a step-rate static_assert in stepper.cpp and a run in
+loadtest/tests/profile_test.cpp.
+
+*/
+
+#ifndef PROFILE
+
+#define PROFILE
+
+#include <stdint.h>
+
+/// @brief the original chassis: 1/16 microstepped NEMA 17s
+struct FranklinProfile {
+  // GPIO pinouts
+  static constexpr uint8_t dir_pin_1 = 23;
+  static constexpr uint8_t dir_pin_2 = 32;
+  static constexpr uint8_t step_pin_1 = 15;
+  static constexpr uint8_t step_pin_2 = 33;
+  static constexpr uint8_t aux_power_1 = 18;
+
+  // stepper settings
+  static constexpr uint32_t steps_per_rev = 3200;
+  static constexpr double max_angular_velocity = 50; // rad/s
+
+  // motion control parameters
+  static constexpr double alpha = 0.125;
+  static constexpr double kyle_constant = 0.8; // weight of the gyro prediction
+
+  static constexpr double proportional_scale = 200; // ^-1
+  static constexpr double integral_scale = 50;
+  static constexpr double derivative_scale = -200;
+
+  static constexpr double maximum_integral = 100;
+
+  // LQR gains, precomputed offline. Model: wheeled inverted pendulum
+  // linearised about upright with the wheel acceleration as input,
+  // g = 9.81 m/s^2, centre of mass 0.10 m above the axle, wheel radius
+  // 0.04 m, discretised at GYRO_POLL_DELAY (25 ms).
+  // Q = diag(200, 2, 1, 2), R = 0.01 in SI units; tilt gains are then
+  // rescaled to degrees. Units: rad/s^2 per degree, per degree/s, per rad
+  // and per rad/s
+  static constexpr double lqr_k_tilt = -16.7381;
+  static constexpr double lqr_k_tilt_rate = -1.6898;
+  static constexpr double lqr_k_position = -6.4399;
+  static constexpr double lqr_k_velocity = -10.9741;
+};
+
+/// @brief the same chassis with the drivers jumpered to 1/8 microstepping
+struct FranklinEighthStepProfile : FranklinProfile {
+  static constexpr uint32_t steps_per_rev = 1600;
+};
+
+#if defined(PROFILE_FRANKLIN_EIGHTH_STEP)
+typedef FranklinEighthStepProfile ActiveProfile;
+#else
+typedef FranklinProfile ActiveProfile;
+#endif
+
+#endif
@@ -0,0 +1,127 @@
+/*
+
+Wire protocol codec. Kept free of Arduino dependencies so the same code can
+be compiled for the firmware and for host-side tooling.
+
+v1 frame:
+  0x46 0x46 | op | length (u16, big endian) | payload
+
+v2 frame (negotiated per connection with the OpNegotiate operation):
+  0x46 0x46 | version | op | length (varint) | payload | crc16 (big endian)
+
+The v2 CRC is CRC-16/CCITT-FALSE over everything from the version byte up to
+the end of the payload. Zero-length payloads are allowed.
+
+*/
+
+#ifndef PROTOCOL
+
+#define PROTOCOL
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HEADER_BYTE 0x46
+
+#define PROTOCOL_V1 1
+#define PROTOCOL_V2 2
+#define PROTOCOL_MAX_VERSION PROTOCOL_V2
+
+#define V1_HEADER_LENGTH 5
+#define V2_FIXED_HEADER_LENGTH 4 // header bytes, version and op
+#define V2_CRC_LENGTH 2
+#define VARINT_MAX_LENGTH 5
+#define V2_MAX_HEADER_LENGTH (V2_FIXED_HEADER_LENGTH + VARINT_MAX_LENGTH)
+#define MAX_PAYLOAD_LENGTH 1024
+
+/// @brief operation codes understood by the socket server
+enum OperationCode {
+  OpMessage = 0,
+  OpVariableUpdate = 1,
+  OpEcho = 2,
+  OpStatusPoll = 3,
+  OpNegotiate = 4,
+  OpTimeSync = 5,
+  OpLatencyTrace = 6,
+  OpMemoryStats = 7,
+  OpAutotuneStatus = 8,
+  OpTelemetrySummary = 9,
+  OpHeartbeat = 10,
+  OpLinkStatus = 11,
+};
+
+/// @brief the fields that can be requested in a v2 status poll; the value
+/// is the bit index in the field mask and matches the v1 status keys
+enum StatusField {
+  FieldPidProportional = 0,
+  FieldPidIntegral = 1,
+  FieldPidDerivative = 2,
+  FieldMotorsEnabled = 3,
+  FieldGyroOffset = 4,
+  FieldGyroValue = 5,
+  FieldIntegralSum = 6,
+  FieldMotorTarget = 7,
+  StatusFieldCount,
+};
+
+#define STATUS_MASK_ALL ((1u << StatusFieldCount) - 1)
+
+/// @brief type tags written before each value in a v2 status response
+enum FieldType {
+  TypeInt16 = 1,
+  TypeBool = 2,
+  TypeFloat32 = 3,
+};
+
+/// @brief the values reported by a status poll, in their natural units
+struct StatusSnapshot {
+  int16_t pid_proportional;
+  int16_t pid_integral;
+  int16_t pid_derivative;
+  bool motors_enabled;
+  float gyro_offset;
+  float gyro_value;
+  float integral_sum;
+  float motor_target;
+};
+
+/// @brief incremental varint decoder, fed one byte at a time
+struct VarintDecoder {
+  uint32_t value;
+  uint8_t shift;
+};
+
+enum VarintStatus {
+  VarintIncomplete,
+  VarintDone,
+  VarintOverflow,
+};
+
+void put_u16(uint16_t value, uint8_t *out);
+void put_u32(uint32_t value, uint8_t *out);
+void put_u64(uint64_t value, uint8_t *out);
+uint16_t get_u16(const uint8_t *data);
+uint32_t get_u32(const uint8_t *data);
+uint64_t get_u64(const uint8_t *data);
+void put_f32(float value, uint8_t *out);
+float get_f32(const uint8_t *data);
+
+uint16_t crc16_update(uint16_t crc, const uint8_t *data, size_t length);
+uint16_t crc16(const uint8_t *data, size_t length);
+
+size_t varint_encode(uint32_t value, uint8_t *out);
+void varint_reset(VarintDecoder *decoder);
+VarintStatus varint_feed(VarintDecoder *decoder, uint8_t byte);
+size_t varint_decode(const uint8_t *data, size_t length, uint32_t *value);
+
+size_t encode_v1_header(uint8_t operation, uint16_t payload_length, uint8_t *out);
+size_t encode_v2_header(uint8_t operation, uint32_t payload_length, uint8_t *out);
+uint16_t v2_frame_crc(const uint8_t *header, size_t header_length, const uint8_t *payload, size_t payload_length);
+size_t encode_v2_frame(uint8_t operation, const uint8_t *payload, size_t payload_length, uint8_t *out, size_t capacity);
+size_t decode_v2_frame(const uint8_t *data, size_t length, uint8_t *operation, const uint8_t **payload, uint32_t *payload_length);
+
+size_t status_v2_length(uint32_t mask);
+size_t encode_status_v2(const StatusSnapshot *status, uint32_t mask, uint8_t *out, size_t capacity);
+bool decode_status_v2(const uint8_t *data, size_t length, StatusSnapshot *status, uint32_t *mask);
+
+#endif
@@ -1 +1,83 @@
-void stepper_loop(void *_);
\ No newline at end of file
+#ifndef STEPPER
+
+#define STEPPER
+
+#include <stdint.h>
+#include "profile.h"
+
+#define STEP_TICK_MICROS 20 // period of the phase accumulator tick
+#define STEP_PULSE_MICROS 4 // high time of the step pulse
+
+/// @brief which motors are due a step on a single stepper tick
+struct StepperTick {
+  bool step_1;
+  bool step_2;
+};
+
+/// @brief per-motor DDS state; a step is emitted each time phase wraps
+struct PhaseAccumulator {
+  uint32_t phase;
+  uint32_t increment;
+  bool reverse;
+};
+
+/// @brief the highest step rate a profile can request, in steps per second
+template <typename Profile>
+constexpr double max_step_rate() {
+  return Profile::max_angular_velocity * Profile::steps_per_rev / (2 * 3.14159265358979);
+}
+
+/// @brief converts motor angular velocity into the phase added each tick
+/// @param angular_velocity is the targetted angular velocity, in rad/s
+/// @return the unsigned phase increment; 2^32 corresponds to one step per tick
+template <typename Profile>
+uint32_t angular_vel_to_phase_increment(double angular_velocity) {
+  double speed = angular_velocity < 0 ? -angular_velocity : angular_velocity;
+  double steps_per_tick = (speed * Profile::steps_per_rev * STEP_TICK_MICROS) / (2 * 3.14159265358979 * 1E6);
+  double increment = steps_per_tick * 4294967296.0; // 2^32
+
+  // the step pin can only pulse once per tick
+  if (increment >= 4294967295.0) {
+    return UINT32_MAX;
+  }
+
+  return (uint32_t)(increment + 0.5);
+}
+
+/// @brief retargets an accumulator without resetting its phase, so rate
+/// changes do not introduce a step-timing discontinuity
+/// @param acc the accumulator to update
+/// @param angular_velocity is the targetted angular velocity, in rad/s
+template <typename Profile>
+void set_accumulator_target(PhaseAccumulator *acc, double angular_velocity) {
+  acc->increment = angular_vel_to_phase_increment<Profile>(angular_velocity);
+  acc->reverse = angular_velocity < 0;
+}
+
+/// @brief advances an accumulator by one tick
+/// @param acc the accumulator to advance
+/// @return true if the phase wrapped and a step is due
+inline bool advance_accumulator(PhaseAccumulator *acc) {
+  uint32_t previous_phase = acc->phase;
+  acc->phase += acc->increment;
+
+  // UINT32_MAX is the saturated top rate; it falls one step short of a wrap
+  // every tick, so it would otherwise skip the first tick from phase 0
+  if (acc->increment == UINT32_MAX) {
+    return true;
+  }
+
+  return acc->phase < previous_phase;
+}
+
+/// @brief advances both accumulators by one shared tick
+/// @return which motors are due a step on this tick
+inline StepperTick advance_stepper_tick(PhaseAccumulator *acc_1, PhaseAccumulator *acc_2) {
+  return StepperTick{
+    advance_accumulator(acc_1),
+    advance_accumulator(acc_2)};
+}
+
+void stepper_loop(void *_);
+
+#endif
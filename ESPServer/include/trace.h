@@ -0,0 +1,50 @@
+/*
+
+Command latency tracing and host/device clock synchronisation. Like
+protocol.h this is free of Arduino dependencies so host tooling can decode
+the same payloads.
+
+A traced command records the device time (micros, wrapping u32) at each
+stage of the pipeline:
+
+  socket receive -> sock_to_motion_queue -> telemetry_loop dequeue
+    -> motor_update_queue -> stepper_loop dequeue -> first pulse at new rate
+
+*/
+
+#ifndef TRACE
+
+#define TRACE
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TIME_SYNC_REQUEST_LENGTH 8
+#define TIME_SYNC_RESPONSE_LENGTH 24
+#define COMMAND_TRACE_LENGTH 26
+
+/// @brief device timestamps for one command as it moves through the tasks;
+/// a sequence of zero means no command is being traced
+struct CommandTrace {
+  uint16_t sequence;
+  uint32_t socket_receive;
+  uint32_t motion_enqueue;
+  uint32_t motion_dequeue;
+  uint32_t motor_enqueue;
+  uint32_t stepper_dequeue;
+  uint32_t first_pulse;
+};
+
+/// @brief one NTP-style exchange, reduced to a clock offset and round trip
+struct TimeSyncSample {
+  int64_t offset;     // device clock minus host clock, in microseconds
+  int64_t round_trip; // network round trip, excluding device processing
+};
+
+size_t encode_time_sync_response(uint64_t host_send, uint64_t device_receive, uint64_t device_send, uint8_t *out);
+TimeSyncSample time_sync_sample(uint64_t host_send, uint64_t device_receive, uint64_t device_send, uint64_t host_receive);
+
+size_t encode_command_trace(const CommandTrace *trace, uint8_t *out);
+bool decode_command_trace(const uint8_t *data, size_t length, CommandTrace *trace);
+
+#endif
@@ -0,0 +1,1134 @@
+/*
+
+Load generator and soak test for the socket server. The real src/socket.cpp
+runs in a thread on top of the POSIX stand-ins in shim/, a stub motion task
+feeds its queues, and the generator drives it over localhost with v1 and v2
+traffic, malformed frames and reconnect storms. The link scenario arms the
+control-link watchdog and walks it through a simulated lossy link.
+
+  make && ./loadtest --scenario soak --duration 600
+
+Every report interval a line of throughput, latency and memory figures is
+printed; a per-operation summary follows at the end. The exit code is
+non-zero if any well-formed request went unanswered.
+
+*/
+
+#include <esp_timer.h>
+#include "common.h"
+#include "pool.h"
+
+#include <arpa/inet.h>
+#include <malloc.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+void websocket_loop(void *_);
+
+#define REQUESTS_PER_ROUND 500
+#define RESPONSE_TIMEOUT_MILLIS 3000
+
+QueueHandle_t sock_to_motion_queue = NULL;
+QueueHandle_t motor_update_queue = NULL;
+QueueHandle_t motion_to_sock_queue = NULL;
+QueueHandle_t trace_to_sock_queue = NULL;
+QueueHandle_t autotune_to_sock_queue = NULL;
+QueueHandle_t summary_to_sock_queue = NULL;
+QueueHandle_t link_to_motion_queue = NULL;
+QueueHandle_t link_to_sock_queue = NULL;
+
+TaskHandle_t websocket_task = NULL;
+TaskHandle_t telemetry_task = NULL;
+TaskHandle_t stepper_task = NULL;
+
+// allocations made by the server thread, counted through the linker's
+// --wrap=malloc,--wrap=free hooks (see the Makefile)
+static thread_local bool in_server_thread = false;
+static std::atomic<uint64_t> server_allocations(0);
+static std::atomic<uint64_t> server_frees(0);
+static std::atomic<int64_t> server_bytes_outstanding(0);
+
+extern "C" void *__real_malloc(size_t size);
+extern "C" void __real_free(void *pointer);
+
+extern "C" void *__wrap_malloc(size_t size) {
+  void *pointer = __real_malloc(size);
+  if (in_server_thread && pointer != NULL) {
+    server_allocations++;
+    server_bytes_outstanding += malloc_usable_size(pointer);
+  }
+  return pointer;
+}
+
+extern "C" void __wrap_free(void *pointer) {
+  if (in_server_thread && pointer != NULL) {
+    server_frees++;
+    server_bytes_outstanding -= malloc_usable_size(pointer);
+  }
+  __real_free(pointer);
+}
+
+/// @brief command line options
+struct Options {
+  uint16_t port = 18080;
+  std::string scenario = "soak";
+  uint8_t protocol = PROTOCOL_V1;
+  double duration = 10;
+  double report_interval = 5;
+  bool verbose = false;
+};
+
+/// @brief latency samples and error counts for one kind of request
+struct OperationStats {
+  std::vector<uint32_t> latencies; // microseconds
+  uint64_t count = 0;
+  uint64_t errors = 0;
+
+  void record(uint32_t latency) {
+    latencies.push_back(latency);
+    count++;
+  }
+
+  /// @brief the latency below which a fraction p of the samples fall
+  uint32_t percentile(double p) {
+    if (latencies.empty()) {
+      return 0;
+    }
+    size_t index = std::min(latencies.size() - 1, (size_t)(p * latencies.size()));
+    std::nth_element(latencies.begin(), latencies.begin() + index, latencies.end());
+    return latencies[index];
+  }
+};
+
+/// @brief stats for the whole run and for the current report interval
+struct Report {
+  std::map<std::string, OperationStats> total;
+  OperationStats interval;
+  uint64_t interval_start = 0;
+  uint64_t run_start = 0;
+  bool reported_stats = false;
+  MemoryStats last_stats;
+
+  void record(const std::string &operation, uint32_t latency) {
+    total[operation].record(latency);
+    interval.record(latency);
+  }
+
+  void error(const std::string &operation) {
+    total[operation].errors++;
+    total[operation].count++;
+    interval.errors++;
+    interval.count++;
+  }
+};
+
+static uint64_t now_micros() {
+  return esp_timer_get_time();
+}
+
+/// @brief a client connection speaking either protocol version
+class Connection {
+ public:
+  ~Connection() {
+    close();
+  }
+
+  bool open(uint16_t port) {
+    close();
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    timeval timeout = {RESPONSE_TIMEOUT_MILLIS / 1000, (RESPONSE_TIMEOUT_MILLIS % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    int enable = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    version = PROTOCOL_V1;
+    if (connect(fd, (sockaddr *)&address, sizeof(address)) < 0) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+    if (fd >= 0) {
+      ::close(fd);
+      fd = -1;
+    }
+  }
+
+  bool send_all(const uint8_t *data, size_t length) {
+    size_t sent = 0;
+    while (sent < length) {
+      ssize_t written = send(fd, data + sent, length - sent, MSG_NOSIGNAL);
+      if (written <= 0) {
+        return false;
+      }
+      sent += written;
+    }
+    return true;
+  }
+
+  bool receive_exact(uint8_t *data, size_t length) {
+    size_t received = 0;
+    while (received < length) {
+      ssize_t read = recv(fd, data + received, length - received, 0);
+      if (read <= 0) {
+        return false;
+      }
+      received += read;
+    }
+    return true;
+  }
+
+  /// @brief sends a request framed in the connection's protocol version
+  bool send_request(uint8_t operation, const uint8_t *payload, size_t length) {
+    std::vector<uint8_t> frame(V2_MAX_HEADER_LENGTH + length + V2_CRC_LENGTH);
+    size_t frame_length;
+
+    if (version == PROTOCOL_V2) {
+      frame_length = encode_v2_frame(operation, payload, length, frame.data(), frame.size());
+    } else {
+      frame_length = encode_v1_header(operation, length, frame.data());
+      if (length > 0) {
+        memcpy(frame.data() + frame_length, payload, length);
+      }
+      frame_length += length;
+    }
+    return send_all(frame.data(), frame_length);
+  }
+
+  /// @brief reads one response frame. v1 status polls carry their length in
+  /// the fourth header byte, and v1 echoes are unframed
+  bool receive_response(uint8_t operation, size_t echo_length, std::vector<uint8_t> *response) {
+    if (version == PROTOCOL_V2) {
+      return receive_v2(operation, response);
+    }
+
+    if (operation == OpEcho) {
+      response->resize(echo_length);
+      return receive_exact(response->data(), echo_length);
+    }
+
+    uint8_t header[V1_HEADER_LENGTH];
+    if (!receive_exact(header, sizeof(header)) || header[0] != HEADER_BYTE || header[1] != HEADER_BYTE) {
+      return false;
+    }
+
+    size_t length;
+    if (operation == OpStatusPoll) {
+      length = header[3];
+    } else if (header[2] == operation) {
+      length = get_u16(header + 3);
+    } else {
+      return false;
+    }
+
+    response->resize(length);
+    return receive_exact(response->data(), length);
+  }
+
+  bool receive_v2(uint8_t operation, std::vector<uint8_t> *response) {
+    std::vector<uint8_t> frame(V2_FIXED_HEADER_LENGTH);
+    if (!receive_exact(frame.data(), V2_FIXED_HEADER_LENGTH)) {
+      return false;
+    }
+
+    VarintDecoder decoder;
+    varint_reset(&decoder);
+    VarintStatus status = VarintIncomplete;
+    while (status == VarintIncomplete) {
+      uint8_t byte;
+      if (!receive_exact(&byte, 1)) {
+        return false;
+      }
+      frame.push_back(byte);
+      status = varint_feed(&decoder, byte);
+    }
+    if (status != VarintDone || decoder.value > MAX_PAYLOAD_LENGTH) {
+      return false;
+    }
+
+    size_t header_length = frame.size();
+    frame.resize(header_length + decoder.value + V2_CRC_LENGTH);
+    if (!receive_exact(frame.data() + header_length, decoder.value + V2_CRC_LENGTH)) {
+      return false;
+    }
+
+    uint8_t received_operation;
+    const uint8_t *payload;
+    uint32_t payload_length;
+    if (decode_v2_frame(frame.data(), frame.size(), &received_operation, &payload, &payload_length) == 0 ||
+        received_operation != operation) {
+      return false;
+    }
+    response->assign(payload, payload + payload_length);
+    return true;
+  }
+
+  /// @brief sends a request and waits for its response
+  bool transact(uint8_t operation, const uint8_t *payload, size_t length, std::vector<uint8_t> *response) {
+    return send_request(operation, payload, length) && receive_response(operation, length, response);
+  }
+
+  /// @brief switches the connection to a protocol version
+  bool negotiate(uint8_t requested) {
+    std::vector<uint8_t> response;
+    if (!transact(OpNegotiate, &requested, 1, &response) || response.size() != 1) {
+      return false;
+    }
+    version = response[0];
+    return version == requested;
+  }
+
+  int fd = -1;
+  uint8_t version = PROTOCOL_V1;
+};
+
+/// @brief what the motion stub has done, so scenarios can check the staged
+/// link response in-process
+struct MotionStubState {
+  LinkControls controls;
+  uint8_t link_state;
+  uint32_t loops[LinkLost + 1];     // control loops run in each link state
+  uint32_t published[LinkLost + 1]; // of those, the ones that published telemetry
+};
+
+static std::mutex motion_stub_mutex;
+static MotionStubState motion_stub_state = {};
+
+static MotionStubState motion_stub_snapshot() {
+  std::lock_guard<std::mutex> lock(motion_stub_mutex);
+  return motion_stub_state;
+}
+
+static void motion_stub_reset_counts() {
+  std::lock_guard<std::mutex> lock(motion_stub_mutex);
+  for (uint8_t i = 0; i <= LinkLost; i++) {
+    motion_stub_state.loops[i] = 0;
+    motion_stub_state.published[i] = 0;
+  }
+}
+
+/// @brief stands in for the telemetry task: drains variable updates, stamps
+/// their traces, runs the link watchdog and its staged response, and
+/// publishes motion info and telemetry windows at the control rate
+/// @param _ unused
+void motion_stub_loop(void *_) {
+  uint32_t tick = 0;
+  TelemetryWindow window;
+  window_reset(&window);
+
+  LinkThresholds link_thresholds = {
+    LINK_DEGRADED_SILENCE,
+    LINK_HOLD_SILENCE,
+    LINK_LOST_SILENCE,
+    LINK_DEGRADED_ROUND_TRIP,
+    LINK_HOLD_ROUND_TRIP,
+    LINK_RECOVERY_TIME};
+  LinkMonitor link_monitor;
+  link_init(&link_monitor, &link_thresholds);
+
+  while (1) {
+    std::unique_lock<std::mutex> lock(motion_stub_mutex);
+    LinkControls *controls = &motion_stub_state.controls;
+
+    ConfigQueueItem update;
+    while (xQueueReceive(sock_to_motion_queue, &update, 0) == pdPASS) {
+      if (update.target == LinearVelocityTarget) {
+        controls->linear_velocity_target = update.value;
+      } else if (update.target == AngularVelocityTarget) {
+        controls->angular_velocity_target = update.value;
+      } else if (update.target == MotorsEnabled && (update.value != 1 || link_allows_motors(&link_monitor))) {
+        controls->motors_enabled = update.value == 1;
+      } else if (update.target == LinkWatchdog) {
+        link_arm(&link_monitor, update.value == 1, millis());
+      }
+      if (update.trace.sequence != 0) {
+        update.trace.motion_dequeue = micros();
+        update.trace.motor_enqueue = micros();
+        update.trace.stepper_dequeue = micros();
+        update.trace.first_pulse = micros();
+        xQueueOverwrite(trace_to_sock_queue, &update.trace);
+      }
+    }
+
+    LinkReport link_report_item;
+    if (xQueueReceive(link_to_motion_queue, &link_report_item, 0) == pdPASS) {
+      link_report(&link_monitor, &link_report_item);
+    }
+    uint8_t state = link_update(&link_monitor, millis());
+    bool publish_telemetry = link_respond(&link_monitor, tick, LINK_TELEMETRY_DIVISOR, controls);
+    bool motors_enabled = controls->motors_enabled;
+    motion_stub_state.link_state = state;
+    motion_stub_state.loops[state]++;
+    motion_stub_state.published[state] += publish_telemetry ? 1 : 0;
+    lock.unlock();
+    xQueueOverwrite(link_to_sock_queue, &link_monitor);
+
+    MotionInfoQueueItem motion_info;
+    motion_info.motion_info.gyro_value = sin(tick * 0.05);
+    motion_info.motion_info.motor_target = cos(tick * 0.05);
+    motion_info.motion_info.integral_sum = tick % 100;
+    motion_info.motion_info.motors_enabled = motors_enabled;
+    if (publish_telemetry) {
+      xQueueOverwrite(motion_to_sock_queue, &motion_info);
+    }
+
+    float samples[AggregateFieldCount];
+    samples[AggregateTilt] = motion_info.motion_info.gyro_value;
+    samples[AggregateTiltRate] = motion_info.motion_info.motor_target;
+    samples[AggregateMotorTarget] = motion_info.motion_info.motor_target;
+    samples[AggregateIntegralSum] = motion_info.motion_info.integral_sum;
+    window_add(&window, samples, micros());
+    if (publish_telemetry && window.samples >= AGGREGATE_WINDOW_SAMPLES &&
+        xQueueSend(summary_to_sock_queue, &window, 0) == pdPASS) {
+      window_reset(&window);
+    }
+
+    tick++;
+    delay(GYRO_POLL_DELAY);
+  }
+}
+
+void server_thread_loop(bool verbose) {
+  in_server_thread = true;
+  Serial.set_echo(verbose);
+  websocket_loop(NULL);
+}
+
+/// @brief runs a request and records its latency
+/// @param check optional validation of the response
+template <typename Check>
+bool timed_transact(Connection *connection, Report *report, const std::string &name, uint8_t operation,
+                    const uint8_t *payload, size_t length, Check check) {
+  std::vector<uint8_t> response;
+  uint64_t start = now_micros();
+  if (!connection->transact(operation, payload, length, &response) || !check(response)) {
+    report->error(name);
+    return false;
+  }
+  report->record(name, now_micros() - start);
+  return true;
+}
+
+static std::string name_for(const char *operation, uint8_t version) {
+  return std::string(operation) + (version == PROTOCOL_V2 ? " v2" : " v1");
+}
+
+/// @brief opens a connection and negotiates a protocol version
+static bool connect_as(Connection *connection, const Options &options, uint8_t version, Report *report) {
+  if (!connection->open(options.port)) {
+    report->error("connect");
+    return false;
+  }
+  if (version == PROTOCOL_V2 && !connection->negotiate(PROTOCOL_V2)) {
+    report->error("negotiate");
+    return false;
+  }
+  return true;
+}
+
+static bool status_request(Connection *connection, Report *report) {
+  uint8_t version = connection->version;
+  uint8_t mask[VARINT_MAX_LENGTH];
+  size_t mask_length = version == PROTOCOL_V2 ? varint_encode(STATUS_MASK_ALL, mask) : 0;
+
+  return timed_transact(connection, report, name_for("status", version), OpStatusPoll, mask, mask_length,
+                        [version](const std::vector<uint8_t> &response) {
+                          if (version == PROTOCOL_V2) {
+                            StatusSnapshot status;
+                            uint32_t mask;
+                            return decode_status_v2(response.data(), response.size(), &status, &mask) &&
+                                   mask == STATUS_MASK_ALL;
+                          }
+                          return response.size() == 4 * StatusFieldCount;
+                        });
+}
+
+static bool echo_request(Connection *connection, Report *report, std::mt19937 *random) {
+  std::vector<uint8_t> payload(1 + (*random)() % 64);
+  for (uint8_t &byte : payload) {
+    byte = (*random)();
+  }
+  return timed_transact(connection, report, name_for("echo", connection->version), OpEcho, payload.data(),
+                        payload.size(), [&payload](const std::vector<uint8_t> &response) {
+                          return response == payload;
+                        });
+}
+
+static bool memory_request(Connection *connection, Report *report) {
+  return timed_transact(connection, report, name_for("memory stats", connection->version), OpMemoryStats, NULL, 0,
+                        [report](const std::vector<uint8_t> &response) {
+                          if (response.size() != MEMORY_STATS_LENGTH) {
+                            return false;
+                          }
+                          // pool fields follow the six stack and heap figures
+                          const uint8_t *pool = response.data() + 24;
+                          report->last_stats.pool_blocks = get_u32(pool);
+                          report->last_stats.pool_in_use = get_u32(pool + 4);
+                          report->last_stats.pool_peak = get_u32(pool + 8);
+                          report->last_stats.pool_failures = get_u32(pool + 12);
+                          report->reported_stats = true;
+                          return true;
+                        });
+}
+
+/// @brief sends a request that has no response, timing only the send
+static bool unanswered_request(Connection *connection, Report *report, const char *name, uint8_t operation,
+                               const uint8_t *payload, size_t length) {
+  uint64_t start = now_micros();
+  if (!connection->send_request(operation, payload, length)) {
+    report->error(name_for(name, connection->version));
+    return false;
+  }
+  report->record(name_for(name, connection->version), now_micros() - start);
+  return true;
+}
+
+/// @brief a burst of status polls over one connection
+static void run_status(const Options &options, uint8_t version, Report *report) {
+  Connection connection;
+  if (!connect_as(&connection, options, version, report)) {
+    return;
+  }
+  for (int i = 0; i < REQUESTS_PER_ROUND; i++) {
+    if (!status_request(&connection, report)) {
+      return;
+    }
+  }
+  memory_request(&connection, report);
+}
+
+/// @brief a random mix of every operation over one connection
+static void run_mixed(const Options &options, uint8_t version, Report *report, std::mt19937 *random) {
+  Connection connection;
+  if (!connect_as(&connection, options, version, report)) {
+    return;
+  }
+
+  for (int i = 0; i < REQUESTS_PER_ROUND; i++) {
+    bool ok = true;
+    switch ((*random)() % 9) {
+      case 0:
+        ok = status_request(&connection, report);
+        break;
+      case 1:
+        ok = echo_request(&connection, report, random);
+        break;
+      case 2: {
+        // velocity targets are harmless to the stub motion task
+        uint8_t target = (*random)() % 2 ? LinearVelocityTarget : AngularVelocityTarget;
+        int16_t value = (int16_t)((*random)() % 200) - 100;
+        uint8_t payload[] = {target, (uint8_t)(value >> 8), (uint8_t)value};
+        ok = unanswered_request(&connection, report, "variable update", OpVariableUpdate, payload, sizeof(payload));
+        break;
+      }
+      case 3: {
+        const char message[] = "loadtest";
+        ok = unanswered_request(&connection, report, "message", OpMessage, (const uint8_t *)message,
+                                sizeof(message) - 1);
+        break;
+      }
+      case 4: {
+        uint8_t payload[TIME_SYNC_REQUEST_LENGTH];
+        put_u64(now_micros(), payload);
+        ok = timed_transact(&connection, report, name_for("time sync", version), OpTimeSync, payload,
+                            sizeof(payload), [](const std::vector<uint8_t> &response) {
+                              return response.size() == TIME_SYNC_RESPONSE_LENGTH;
+                            });
+        break;
+      }
+      case 5:
+        ok = timed_transact(&connection, report, name_for("latency trace", version), OpLatencyTrace, NULL, 0,
+                            [](const std::vector<uint8_t> &response) {
+                              return response.size() == COMMAND_TRACE_LENGTH;
+                            });
+        break;
+      case 6:
+        ok = memory_request(&connection, report);
+        break;
+      case 7:
+        ok = timed_transact(&connection, report, name_for("autotune status", version), OpAutotuneStatus, NULL, 0,
+                            [](const std::vector<uint8_t> &response) {
+                              return response.size() == AUTOTUNE_STATUS_LENGTH;
+                            });
+        break;
+      case 8:
+        ok = timed_transact(&connection, report, name_for("telemetry summary", version), OpTelemetrySummary, NULL,
+                            0, [](const std::vector<uint8_t> &response) {
+                              TelemetrySummary summary;
+                              return decode_telemetry_summary(response.data(), response.size(), &summary);
+                            });
+        break;
+    }
+    if (!ok) {
+      return;
+    }
+  }
+}
+
+/// @brief a malformed request and how the server should recover from it
+struct MalformedCase {
+  const char *name;
+  uint8_t version;
+  std::vector<uint8_t> bytes;
+  bool stays_aligned; // the server can keep serving the same connection
+};
+
+static std::vector<MalformedCase> malformed_cases() {
+  std::vector<MalformedCase> cases;
+
+  cases.push_back({"bad header v1", PROTOCOL_V1, {0x00, 0x11, 0x22, 0x33, 0x44}, true});
+  cases.push_back({"unknown op v1", PROTOCOL_V1, {HEADER_BYTE, HEADER_BYTE, 200, 0, 3, 1, 2, 3}, true});
+  cases.push_back({"short update v1", PROTOCOL_V1, {HEADER_BYTE, HEADER_BYTE, OpVariableUpdate, 0, 1, 0}, true});
+  cases.push_back({"truncated v1", PROTOCOL_V1, {HEADER_BYTE, HEADER_BYTE, OpEcho, 0, 100, 1, 2, 3}, false});
+  cases.push_back({"oversized v1", PROTOCOL_V1, {HEADER_BYTE, HEADER_BYTE, OpEcho, 0xFF, 0xFF}, false});
+
+  uint8_t payload[] = {1, 2, 3};
+  std::vector<uint8_t> bad_crc(V2_MAX_HEADER_LENGTH + sizeof(payload) + V2_CRC_LENGTH);
+  bad_crc.resize(encode_v2_frame(OpEcho, payload, sizeof(payload), bad_crc.data(), bad_crc.size()));
+  bad_crc.back() ^= 0xFF;
+  cases.push_back({"bad crc v2", PROTOCOL_V2, bad_crc, true});
+
+  std::vector<uint8_t> oversized(V2_MAX_HEADER_LENGTH);
+  oversized.resize(encode_v2_header(OpEcho, MAX_PAYLOAD_LENGTH + 1, oversized.data()));
+  cases.push_back({"oversized v2", PROTOCOL_V2, oversized, false});
+
+  cases.push_back({"varint overflow v2", PROTOCOL_V2,
+                   {HEADER_BYTE, HEADER_BYTE, PROTOCOL_V2, OpEcho, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80}, false});
+  cases.push_back({"junk before header v2", PROTOCOL_V2,
+                   {0x00, HEADER_BYTE, 0x13, HEADER_BYTE, HEADER_BYTE, HEADER_BYTE, 0x07}, true});
+  cases.push_back({"split header v2", PROTOCOL_V2, {0x22, HEADER_BYTE, HEADER_BYTE}, true});
+  return cases;
+}
+
+/// @brief sends each malformed case, then checks the server still answers.
+/// Recovery time is recorded against the case's name
+static void run_malformed(const Options &options, Report *report, std::mt19937 *random) {
+  for (const MalformedCase &malformed : malformed_cases()) {
+    std::string name = std::string("malformed: ") + malformed.name;
+    Connection connection;
+    if (!connect_as(&connection, options, malformed.version, report)) {
+      continue;
+    }
+
+    uint64_t start = now_micros();
+    if (!connection.send_all(malformed.bytes.data(), malformed.bytes.size())) {
+      report->error(name);
+      continue;
+    }
+
+    if (!malformed.stays_aligned) {
+      connection.close();
+      if (!connect_as(&connection, options, malformed.version, report)) {
+        continue;
+      }
+    }
+
+    Report probe;
+    if (echo_request(&connection, &probe, random)) {
+      report->record(name, now_micros() - start);
+    } else {
+      report->error(name);
+    }
+  }
+
+  // a malformed status mask is still answered, with no fields selected
+  Connection connection;
+  if (connect_as(&connection, options, PROTOCOL_V2, report)) {
+    uint8_t truncated_mask = 0x80;
+    std::vector<uint8_t> response;
+    StatusSnapshot status;
+    uint32_t mask = STATUS_MASK_ALL;
+
+    uint64_t start = now_micros();
+    if (connection.transact(OpStatusPoll, &truncated_mask, 1, &response) &&
+        decode_status_v2(response.data(), response.size(), &status, &mask) && mask == 0) {
+      report->record("malformed: status mask v2", now_micros() - start);
+    } else {
+      report->error("malformed: status mask v2");
+    }
+  }
+}
+
+/// @brief opens, polls and closes connections in quick succession; the
+/// latency covers connect to first response
+static void run_reconnect(const Options &options, uint8_t version, Report *report) {
+  for (int i = 0; i < REQUESTS_PER_ROUND / 10; i++) {
+    std::string name = name_for("reconnect", version);
+    uint64_t start = now_micros();
+    Connection connection;
+    Report probe;
+    if (!connect_as(&connection, options, version, &probe) || !status_request(&connection, &probe)) {
+      report->error(name);
+      continue;
+    }
+    report->record(name, now_micros() - start);
+  }
+}
+
+/// @brief sends heartbeats over a simulated lossy link
+/// @param duration how long to run, in ms
+/// @param loss the chance that a heartbeat is never sent
+/// @param latency extra delay before each response is read, in ms
+/// @param round_trip the last measured round trip in us; updated
+static bool lossy_heartbeats(Connection *connection, Report *report, std::mt19937 *random, uint32_t duration,
+                             double loss, uint32_t latency, uint16_t *sequence, uint32_t *round_trip) {
+  std::uniform_real_distribution<double> chance(0, 1);
+  uint64_t end = now_micros() + (uint64_t)duration * 1000;
+
+  while (now_micros() < end) {
+    if (chance(*random) >= loss) {
+      uint8_t payload[HEARTBEAT_REQUEST_LENGTH];
+      put_u16(++*sequence, payload);
+      put_u32(*round_trip, payload + 2);
+
+      std::vector<uint8_t> response;
+      uint64_t start = now_micros();
+      if (!connection->send_request(OpHeartbeat, payload, sizeof(payload))) {
+        report->error("heartbeat");
+        return false;
+      }
+      delay(latency);
+      if (!connection->receive_response(OpHeartbeat, 0, &response) || response.size() != HEARTBEAT_RESPONSE_LENGTH ||
+          get_u16(response.data()) != *sequence) {
+        report->error("heartbeat");
+        return false;
+      }
+      *round_trip = now_micros() - start;
+      report->record("heartbeat", *round_trip);
+    }
+    delay(50);
+  }
+  return true;
+}
+
+/// @brief sends heartbeats that each report the same round trip, each
+/// followed at once by a status poll that carries none
+/// @param count the number of heartbeats
+static bool heartbeats_between_polls(Connection *connection, Report *report, uint16_t count, uint16_t *sequence,
+                                     uint32_t round_trip) {
+  for (uint16_t i = 0; i < count; i++) {
+    uint8_t payload[HEARTBEAT_REQUEST_LENGTH];
+    put_u16(++*sequence, payload);
+    put_u32(round_trip, payload + 2);
+
+    std::vector<uint8_t> response;
+    if (!connection->transact(OpHeartbeat, payload, sizeof(payload), &response) ||
+        response.size() != HEARTBEAT_RESPONSE_LENGTH || !connection->transact(OpStatusPoll, NULL, 0, &response)) {
+      report->error("heartbeat");
+      return false;
+    }
+    delay(50);
+  }
+  return true;
+}
+
+/// @brief stays silent, as if the link had dropped every packet
+static void blackout(uint32_t duration) {
+  delay(duration);
+}
+
+/// @brief fetches the link status and checks the watchdog's state
+static bool expect_link_state(Connection *connection, Report *report, const char *check, uint8_t expected,
+                              std::vector<uint8_t> *status) {
+  std::string name = std::string("link: ") + check;
+  uint64_t start = now_micros();
+  if (!connection->transact(OpLinkStatus, NULL, 0, status) || status->size() < LINK_STATUS_HEADER_LENGTH) {
+    report->error(name);
+    return false;
+  }
+
+  const char *names[] = {"healthy", "degraded", "hold", "lost"};
+  uint8_t state = (*status)[0];
+  printf("link: %-34s state %-8s round trip %6u us  silence %5u ms\n", check, names[state & 3],
+         get_u32(status->data() + 6), get_u32(status->data() + 2));
+
+  if (state != expected) {
+    printf("link: expected %s\n", names[expected]);
+    report->error(name);
+    return false;
+  }
+  report->record(name, now_micros() - start);
+  return true;
+}
+
+static bool send_update(Connection *connection, uint8_t target, int16_t value) {
+  uint8_t payload[] = {target, (uint8_t)(value >> 8), (uint8_t)value};
+  return connection->send_request(OpVariableUpdate, payload, sizeof(payload));
+}
+
+/// @brief records a check against the motion stub's state
+static bool expect_stub(Report *report, const char *check, bool passed) {
+  std::string name = std::string("link: ") + check;
+  MotionStubState stub = motion_stub_snapshot();
+  printf("link: %-34s targets %4d %4d  motors %s\n", check, stub.controls.linear_velocity_target,
+         stub.controls.angular_velocity_target, stub.controls.motors_enabled ? "on" : "off");
+  if (!passed) {
+    report->error(name);
+    return false;
+  }
+  report->record(name, 0);
+  return true;
+}
+
+/// @brief polls the status and checks the motors' state the server reports
+static bool expect_motors(Connection *connection, Report *report, const char *check, bool expected) {
+  std::string name = std::string("link: ") + check + " (poll)";
+  std::vector<uint8_t> poll;
+  if (!connection->transact(OpStatusPoll, NULL, 0, &poll) || poll.size() != 4 * StatusFieldCount) {
+    report->error(name);
+    return false;
+  }
+  if ((get_u16(poll.data() + 4 * FieldMotorsEnabled + 1) != 0) != expected) {
+    printf("link: status poll reports the motors %s\n", expected ? "off" : "on");
+    report->error(name);
+    return false;
+  }
+  report->record(name, 0);
+  return true;
+}
+
+/// @brief arms the link watchdog and degrades the link in stages: added
+/// latency, then a blackout long enough to hold and then lose the link,
+/// then a lossy but live link it should recover on. Each stage's response
+/// is checked against the motion stub, recovery must wait out the recovery
+/// window, and the recorded transitions must be in order and timestamped.
+/// Last, slow heartbeats between polls must still raise the round trip
+static void run_link(const Options &options, Report *report, std::mt19937 *random) {
+  Connection connection;
+  if (!connect_as(&connection, options, PROTOCOL_V1, report)) {
+    return;
+  }
+
+  uint16_t sequence = 0;
+  uint32_t round_trip = 0;
+  std::vector<uint8_t> status;
+
+  // wait until the server has accepted us, so the first round trip does not
+  // include its accept poll
+  if (!connection.transact(OpStatusPoll, NULL, 0, &status)) {
+    report->error("link: connect");
+    return;
+  }
+
+  send_update(&connection, MotorsEnabled, 1);
+  send_update(&connection, LinkWatchdog, 1);
+  send_update(&connection, LinearVelocityTarget, 50);
+
+  bool ok = lossy_heartbeats(&connection, report, random, 1500, 0, 0, &sequence, &round_trip) &&
+            expect_link_state(&connection, report, "clean link", LinkHealthy, &status);
+  if (ok) {
+    MotionStubState stub = motion_stub_snapshot();
+    ok = expect_stub(report, "driving while healthy",
+                     stub.controls.linear_velocity_target == 50 && stub.controls.motors_enabled &&
+                         stub.published[LinkHealthy] == stub.loops[LinkHealthy]);
+  }
+
+  if (ok) {
+    motion_stub_reset_counts();
+    ok = lossy_heartbeats(&connection, report, random, 3000, 0, 200, &sequence, &round_trip) &&
+         expect_link_state(&connection, report, "200 ms of added latency", LinkDegraded, &status);
+  }
+  if (ok) {
+    // telemetry is shed to every nth loop, but the robot keeps driving
+    MotionStubState stub = motion_stub_snapshot();
+    uint32_t loops = stub.loops[LinkDegraded];
+    uint32_t published = stub.published[LinkDegraded];
+    printf("link: degraded for %u loops, published %u\n", loops, published);
+    ok = expect_stub(report, "shedding telemetry",
+                     loops >= LINK_TELEMETRY_DIVISOR && published * LINK_TELEMETRY_DIVISOR + LINK_TELEMETRY_DIVISOR > loops &&
+                         published * LINK_TELEMETRY_DIVISOR < loops + LINK_TELEMETRY_DIVISOR &&
+                         stub.controls.linear_velocity_target == 50);
+  }
+
+  if (ok) {
+    blackout(LINK_HOLD_SILENCE + 200);
+    ok = expect_link_state(&connection, report, "short blackout", LinkHold, &status);
+  }
+  if (ok) {
+    MotionStubState stub = motion_stub_snapshot();
+    ok = expect_stub(report, "holding position",
+                     stub.controls.linear_velocity_target == 0 && stub.controls.angular_velocity_target == 0 &&
+                         stub.controls.motors_enabled);
+  }
+
+  if (ok) {
+    blackout(LINK_LOST_SILENCE + 200);
+    ok = expect_link_state(&connection, report, "long blackout", LinkLost, &status);
+  }
+  if (ok) {
+    ok = expect_stub(report, "motors disabled", !motion_stub_snapshot().controls.motors_enabled) &&
+         expect_motors(&connection, report, "motors disabled", false);
+  }
+
+  // heartbeats resume, but the link stays lost until the recovery window
+  // has passed, and enabling the motors is refused until then
+  uint32_t resumed = millis();
+  ok = ok && send_update(&connection, MotorsEnabled, 1) &&
+       lossy_heartbeats(&connection, report, random, LINK_RECOVERY_TIME / 2, 0.3, 0, &sequence, &round_trip) &&
+       expect_link_state(&connection, report, "lost while recovering", LinkLost, &status);
+  if (ok) {
+    ok = expect_stub(report, "refused enable", !motion_stub_snapshot().controls.motors_enabled) &&
+         expect_motors(&connection, report, "refused enable", false);
+  }
+
+  ok = ok && lossy_heartbeats(&connection, report, random, 3000, 0.3, 0, &sequence, &round_trip) &&
+       expect_link_state(&connection, report, "30% loss, low latency", LinkHealthy, &status);
+
+  if (ok) {
+    // every stage must appear, in order, with timestamps that never go back
+    uint8_t retained = status[14];
+    uint8_t expected[] = {LinkHealthy, LinkDegraded, LinkHold, LinkLost, LinkHealthy};
+    const char *causes[] = {"silence", "round trip", "recovered", "armed", "disarmed"};
+    uint8_t matched = 0;
+    uint32_t previous = 0;
+    uint32_t recovered = 0;
+
+    for (uint8_t i = 0; i < retained; i++) {
+      const uint8_t *transition = status.data() + LINK_STATUS_HEADER_LENGTH + i * LINK_TRANSITION_LENGTH;
+      uint32_t timestamp = get_u32(transition);
+      printf("link: transition at %8u ms  %u -> %u  (%s)\n", timestamp, transition[4], transition[5],
+             causes[transition[6] % 5]);
+
+      if (i > 0 && timestamp < previous) {
+        ok = false;
+      }
+      previous = timestamp;
+      if (matched < sizeof(expected) && transition[5] == expected[matched]) {
+        matched++;
+      }
+      if (transition[4] == LinkLost && recovered == 0) {
+        recovered = timestamp;
+      }
+    }
+
+    if (ok && matched == sizeof(expected)) {
+      report->record("link: transitions", 0);
+    } else {
+      report->error("link: transitions");
+    }
+
+    printf("link: heartbeats resumed at %u ms, left lost at %u ms\n", resumed, recovered);
+    if (recovered != 0 && recovered - resumed >= LINK_RECOVERY_TIME) {
+      report->record("link: recovery window", 0);
+    } else {
+      report->error("link: recovery window");
+    }
+  }
+
+  // once recovered, the client can enable the motors again
+  ok = ok && send_update(&connection, MotorsEnabled, 1) &&
+       lossy_heartbeats(&connection, report, random, 300, 0, 0, &sequence, &round_trip) &&
+       expect_link_state(&connection, report, "after re-enabling", LinkHealthy, &status);
+  if (ok) {
+    ok = expect_stub(report, "re-enabled", motion_stub_snapshot().controls.motors_enabled) &&
+         expect_motors(&connection, report, "re-enabled", true);
+  }
+
+  // a request without a round trip must not discard the heartbeat's
+  if (ok) {
+    ok = heartbeats_between_polls(&connection, report, 20, &sequence, 2 * LINK_HOLD_ROUND_TRIP) &&
+         expect_link_state(&connection, report, "slow heartbeats, polled", LinkHold, &status);
+  }
+
+  send_update(&connection, LinkWatchdog, 0);
+  send_update(&connection, MotorsEnabled, 0);
+}
+
+static void print_interval(Report *report, uint64_t now) {
+  double elapsed = (now - report->run_start) / 1E6;
+  double seconds = (now - report->interval_start) / 1E6;
+  OperationStats *interval = &report->interval;
+
+  printf("[%7.1fs] %8.0f req/s  p50 %6uus  p99 %7uus  max %7uus  errors %llu",
+         elapsed, interval->count / seconds, interval->percentile(0.5), interval->percentile(0.99),
+         interval->percentile(1.0), (unsigned long long)interval->errors);
+
+  printf("  server heap %lld B in %llu blocks",
+         (long long)server_bytes_outstanding.load(),
+         (unsigned long long)(server_allocations.load() - server_frees.load()));
+
+  if (report->reported_stats) {
+    printf("  pool %u/%u peak %u failures %u", report->last_stats.pool_in_use, report->last_stats.pool_blocks,
+           report->last_stats.pool_peak, report->last_stats.pool_failures);
+  }
+
+  printf("\n");
+  fflush(stdout);
+
+  report->interval = OperationStats();
+  report->interval_start = now;
+}
+
+static void print_summary(Report *report) {
+  double seconds = (now_micros() - report->run_start) / 1E6;
+
+  printf("\n%-30s %9s %7s %9s %9s %9s %9s %9s\n", "operation", "count", "errors", "req/s", "p50 us", "p90 us",
+         "p99 us", "max us");
+  for (auto &entry : report->total) {
+    OperationStats *stats = &entry.second;
+    printf("%-30s %9llu %7llu %9.1f %9u %9u %9u %9u\n", entry.first.c_str(), (unsigned long long)stats->count,
+           (unsigned long long)stats->errors, stats->count / seconds, stats->percentile(0.5),
+           stats->percentile(0.9), stats->percentile(0.99), stats->percentile(1.0));
+  }
+
+  printf("\nserver allocations %llu, frees %llu, outstanding %lld B\n",
+         (unsigned long long)server_allocations.load(), (unsigned long long)server_frees.load(),
+         (long long)server_bytes_outstanding.load());
+#ifdef STATIC_MEMORY
+  printf("memory mode: STATIC_MEMORY (payloads from a %u block pool)\n", PAYLOAD_POOL_BLOCKS);
+#else
+  printf("memory mode: dynamic (payloads from the heap)\n");
+#endif
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: loadtest [options]\n"
+          "  --scenario NAME   status, mixed, malformed, reconnect, link or soak (default soak)\n"
+          "  --protocol N      1 or 2; soak alternates between both (default 1)\n"
+          "  --duration S      seconds to run (default 10)\n"
+          "  --report S        seconds between report lines (default 5)\n"
+          "  --port N          localhost port for the server (default 18080)\n"
+          "  --verbose         echo the server's serial output to stderr\n");
+}
+
+static bool parse_options(int argc, char **argv, Options *options) {
+  for (int i = 1; i < argc; i++) {
+    std::string flag = argv[i];
+    if (flag == "--verbose") {
+      options->verbose = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      return false;
+    }
+    const char *value = argv[++i];
+    if (flag == "--scenario") {
+      options->scenario = value;
+    } else if (flag == "--protocol") {
+      options->protocol = atoi(value);
+    } else if (flag == "--duration") {
+      options->duration = atof(value);
+    } else if (flag == "--report") {
+      options->report_interval = atof(value);
+    } else if (flag == "--port") {
+      options->port = atoi(value);
+    } else {
+      return false;
+    }
+  }
+
+  const char *scenarios[] = {"status", "mixed", "malformed", "reconnect", "link", "soak"};
+  bool known = false;
+  for (const char *scenario : scenarios) {
+    known |= options->scenario == scenario;
+  }
+  return known && (options->protocol == PROTOCOL_V1 || options->protocol == PROTOCOL_V2) &&
+         options->duration > 0 && options->report_interval > 0;
+}
+
+/// @brief waits for the server thread to start listening
+static bool wait_for_server(const Options &options) {
+  for (int attempt = 0; attempt < 100; attempt++) {
+    Connection connection;
+    if (connection.open(options.port)) {
+      return true;
+    }
+    delay(100);
+  }
+  return false;
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  if (!parse_options(argc, argv, &options)) {
+    usage();
+    return 2;
+  }
+
+  sock_to_motion_queue = xQueueCreate(SOCK_TO_MOTION_LENGTH, sizeof(ConfigQueueItem));
+  motion_to_sock_queue = xQueueCreate(MOTION_TO_SOCK_LENGTH, sizeof(MotionInfoQueueItem));
+  trace_to_sock_queue = xQueueCreate(TRACE_TO_SOCK_LENGTH, sizeof(CommandTrace));
+  autotune_to_sock_queue = xQueueCreate(AUTOTUNE_TO_SOCK_LENGTH, sizeof(AutotuneStatus));
+  summary_to_sock_queue = xQueueCreate(SUMMARY_TO_SOCK_LENGTH, sizeof(TelemetryWindow));
+  link_to_motion_queue = xQueueCreate(LINK_TO_MOTION_LENGTH, sizeof(LinkReport));
+  link_to_sock_queue = xQueueCreate(LINK_TO_SOCK_LENGTH, sizeof(LinkMonitor));
+
+  wifi_server_port = options.port;
+  std::thread(server_thread_loop, options.verbose).detach();
+  std::thread(motion_stub_loop, (void *)NULL).detach();
+
+  if (!wait_for_server(options)) {
+    fprintf(stderr, "loadtest: server did not start on port %u\n", options.port);
+    return 1;
+  }
+
+  printf("loadtest: scenario %s for %.0fs on port %u\n", options.scenario.c_str(), options.duration, options.port);
+
+  std::mt19937 random(1);
+  Report report;
+  report.run_start = report.interval_start = now_micros();
+  uint64_t end = report.run_start + (uint64_t)(options.duration * 1E6);
+  uint64_t round = 0;
+
+  while (now_micros() < end) {
+    std::string scenario = options.scenario;
+    uint8_t version = options.protocol;
+
+    // the soak cycles through every scenario in both protocol versions
+    if (scenario == "soak") {
+      const char *rotation[] = {"status", "mixed", "malformed", "reconnect"};
+      scenario = rotation[(round / 2) % 4];
+      version = round % 2 ? PROTOCOL_V2 : PROTOCOL_V1;
+    }
+
+    if (scenario == "status") {
+      run_status(options, version, &report);
+    } else if (scenario == "mixed") {
+      run_mixed(options, version, &report, &random);
+    } else if (scenario == "malformed") {
+      run_malformed(options, &report, &random);
+    } else if (scenario == "link") {
+      run_link(options, &report, &random);
+    } else {
+      run_reconnect(options, version, &report);
+    }
+    round++;
+
+    uint64_t now = now_micros();
+    if (now - report.interval_start >= options.report_interval * 1E6) {
+      print_interval(&report, now);
+    }
+  }
+
+  if (report.interval.count > 0) {
+    print_interval(&report, now_micros());
+  }
+  print_summary(&report);
+
+  uint64_t errors = 0;
+  for (auto &entry : report.total) {
+    errors += entry.second.errors;
+  }
+  return errors == 0 ? 0 : 1;
+}
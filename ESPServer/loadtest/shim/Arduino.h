@@ -0,0 +1,94 @@
+/*
+
+Host stand-in for the parts of the Arduino core and FreeRTOS that the socket
+server uses. Only what the load generator needs is provided; behaviour
+follows the ESP32 core closely enough to exercise the protocol code.
+
+*/
+
+#ifndef LOADTEST_ARDUINO
+
+#define LOADTEST_ARDUINO
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PI 3.1415926535897932384626433832795
+#define RAD_TO_DEG 57.295779513082320876798154814105
+#define HIGH 0x1
+#define LOW 0x0
+#define OUTPUT 0x03
+
+class IPAddress;
+
+// timing
+unsigned long micros();
+unsigned long millis();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+/// @brief Serial stand-in; output is dropped unless echo is enabled
+class HardwareSerial {
+ public:
+  void begin(unsigned long baud);
+  void set_echo(bool echo);
+
+  size_t print(const char *value);
+  size_t print(char value);
+  size_t print(unsigned char value);
+  size_t print(int value);
+  size_t print(unsigned int value);
+  size_t print(long value);
+  size_t print(unsigned long value);
+  size_t print(double value);
+  size_t print(const IPAddress &value);
+  size_t println();
+
+  template <typename T>
+  size_t println(const T &value) {
+    size_t written = print(value);
+    return written + println();
+  }
+
+ private:
+  size_t emit(const char *text);
+  bool echo = false;
+};
+
+extern HardwareSerial Serial;
+
+/// @brief heap figures; the host has no fixed heap, so these are zero. The
+/// load generator reports the server's own allocations instead
+class EspClass {
+ public:
+  uint32_t getFreeHeap() { return 0; }
+  uint32_t getMinFreeHeap() { return 0; }
+  uint32_t getMaxAllocHeap() { return 0; }
+};
+
+extern EspClass ESP;
+
+// FreeRTOS
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+typedef void *TaskHandle_t;
+typedef struct HostQueue *QueueHandle_t;
+
+#define pdPASS 1
+#define pdFAIL 0
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY 0xFFFFFFFF
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait_ms);
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait_ms);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+#endif
@@ -0,0 +1,71 @@
+/*
+
+Host stand-in for the ESP32 WiFi library, backed by POSIX sockets on
+localhost. Copies of a WiFiClient share one socket, as on the ESP32.
+
+*/
+
+#ifndef LOADTEST_WIFI
+
+#define LOADTEST_WIFI
+
+#include <memory>
+#include "Arduino.h"
+
+#define WIFI_AP 2
+
+class IPAddress {
+ public:
+  IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0);
+  uint8_t octets[4];
+};
+
+/// @brief owns a connected socket; closed when the last copy goes away
+struct HostSocket {
+  explicit HostSocket(int fd);
+  ~HostSocket();
+  int fd;
+};
+
+class WiFiClient {
+ public:
+  WiFiClient();
+  explicit WiFiClient(int fd);
+
+  uint8_t connected();
+  int available();
+  size_t readBytes(uint8_t *buffer, size_t length);
+  size_t write(const uint8_t *buffer, size_t length);
+  void setTimeout(unsigned long timeout_ms);
+  void stop();
+  explicit operator bool();
+
+ private:
+  std::shared_ptr<HostSocket> socket;
+  unsigned long timeout_ms = 1000; // Stream's default
+};
+
+/// @brief listens on 127.0.0.1. The port given by the firmware is replaced
+/// by wifi_server_port when that is non-zero, so the host needs no root
+class WiFiServer {
+ public:
+  explicit WiFiServer(uint16_t port);
+  void begin();
+  WiFiClient accept();
+
+ private:
+  uint16_t port;
+  int fd = -1;
+};
+
+class WiFiClass {
+ public:
+  bool mode(int mode) { return true; }
+  bool softAP(const char *ssid, const char *password) { return true; }
+  IPAddress softAPIP() { return IPAddress(127, 0, 0, 1); }
+};
+
+extern WiFiClass WiFi;
+extern uint16_t wifi_server_port;
+
+#endif
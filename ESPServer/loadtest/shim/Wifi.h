@@ -0,0 +1,2 @@
+// datamodel.h includes the library with this spelling
+#include "WiFi.h"
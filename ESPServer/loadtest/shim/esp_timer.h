@@ -0,0 +1,10 @@
+#ifndef LOADTEST_ESP_TIMER
+
+#define LOADTEST_ESP_TIMER
+
+#include <stdint.h>
+
+/// @brief microseconds since the process started
+int64_t esp_timer_get_time();
+
+#endif
@@ -0,0 +1,321 @@
+/*
+
+Host implementations of the Arduino, FreeRTOS and WiFi stand-ins declared in
+this directory.
+
+*/
+
+#include "Arduino.h"
+#include "WiFi.h"
+#include "esp_timer.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+uint16_t wifi_server_port = 0;
+
+static const std::chrono::steady_clock::time_point process_start = std::chrono::steady_clock::now();
+
+int64_t esp_timer_get_time() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+           std::chrono::steady_clock::now() - process_start)
+    .count();
+}
+
+unsigned long micros() {
+  return (uint32_t)esp_timer_get_time(); // wraps like the ESP32's 32-bit counter
+}
+
+unsigned long millis() {
+  return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+void delay(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us) {
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+// serial
+
+void HardwareSerial::begin(unsigned long baud) {}
+
+void HardwareSerial::set_echo(bool echo) {
+  this->echo = echo;
+}
+
+size_t HardwareSerial::emit(const char *text) {
+  if (echo) {
+    fputs(text, stderr);
+  }
+  return strlen(text);
+}
+
+size_t HardwareSerial::print(const char *value) {
+  return emit(value);
+}
+
+size_t HardwareSerial::print(char value) {
+  char text[] = {value, 0};
+  return emit(text);
+}
+
+// like the Arduino core, bytes print as numbers
+size_t HardwareSerial::print(unsigned char value) {
+  return print((unsigned int)value);
+}
+
+size_t HardwareSerial::print(int value) {
+  return print((long)value);
+}
+
+size_t HardwareSerial::print(unsigned int value) {
+  return print((unsigned long)value);
+}
+
+size_t HardwareSerial::print(long value) {
+  char text[24];
+  snprintf(text, sizeof(text), "%ld", value);
+  return emit(text);
+}
+
+size_t HardwareSerial::print(unsigned long value) {
+  char text[24];
+  snprintf(text, sizeof(text), "%lu", value);
+  return emit(text);
+}
+
+size_t HardwareSerial::print(double value) {
+  char text[32];
+  snprintf(text, sizeof(text), "%.2f", value);
+  return emit(text);
+}
+
+size_t HardwareSerial::print(const IPAddress &value) {
+  char text[16];
+  snprintf(text, sizeof(text), "%u.%u.%u.%u", value.octets[0], value.octets[1], value.octets[2], value.octets[3]);
+  return emit(text);
+}
+
+size_t HardwareSerial::println() {
+  return emit("\r\n");
+}
+
+// freertos
+
+/// @brief a fixed-length queue of fixed-size items, as xQueueCreate makes
+struct HostQueue {
+  std::mutex lock;
+  std::condition_variable changed;
+  uint8_t *storage;
+  UBaseType_t length;
+  UBaseType_t item_size;
+  UBaseType_t head;
+  UBaseType_t count;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+  HostQueue *queue = new HostQueue();
+  queue->storage = new uint8_t[length * item_size];
+  queue->length = length;
+  queue->item_size = item_size;
+  queue->head = 0;
+  queue->count = 0;
+  return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait_ms) {
+  std::unique_lock<std::mutex> guard(queue->lock);
+  if (!queue->changed.wait_for(guard, std::chrono::milliseconds(wait_ms), [queue] { return queue->count < queue->length; })) {
+    return pdFAIL;
+  }
+  UBaseType_t tail = (queue->head + queue->count) % queue->length;
+  memcpy(queue->storage + tail * queue->item_size, item, queue->item_size);
+  queue->count++;
+  queue->changed.notify_all();
+  return pdPASS;
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item) {
+  std::lock_guard<std::mutex> guard(queue->lock);
+  memcpy(queue->storage + queue->head * queue->item_size, item, queue->item_size);
+  queue->count = 1;
+  queue->changed.notify_all();
+  return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait_ms) {
+  std::unique_lock<std::mutex> guard(queue->lock);
+  if (!queue->changed.wait_for(guard, std::chrono::milliseconds(wait_ms), [queue] { return queue->count > 0; })) {
+    return pdFAIL;
+  }
+  memcpy(item, queue->storage + queue->head * queue->item_size, queue->item_size);
+  queue->head = (queue->head + 1) % queue->length;
+  queue->count--;
+  queue->changed.notify_all();
+  return pdPASS;
+}
+
+// host threads have no fixed stack to measure
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+  return 0;
+}
+
+// wifi
+
+IPAddress::IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+  octets[0] = a;
+  octets[1] = b;
+  octets[2] = c;
+  octets[3] = d;
+}
+
+HostSocket::HostSocket(int fd) : fd(fd) {}
+
+HostSocket::~HostSocket() {
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+WiFiClient::WiFiClient() {}
+
+WiFiClient::WiFiClient(int fd) : socket(std::make_shared<HostSocket>(fd)) {}
+
+uint8_t WiFiClient::connected() {
+  if (!socket || socket->fd < 0) {
+    return 0;
+  }
+  uint8_t byte;
+  ssize_t peeked = recv(socket->fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (peeked > 0) {
+    return 1;
+  }
+  if (peeked == 0) {
+    return 0; // orderly shutdown by the peer
+  }
+  return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+int WiFiClient::available() {
+  if (!socket || socket->fd < 0) {
+    return 0;
+  }
+  int pending = 0;
+  if (ioctl(socket->fd, FIONREAD, &pending) < 0) {
+    return 0;
+  }
+  return pending;
+}
+
+/// @brief reads until length bytes arrive or the stream timeout passes,
+/// like Stream::readBytes
+size_t WiFiClient::readBytes(uint8_t *buffer, size_t length) {
+  if (!socket || socket->fd < 0) {
+    return 0;
+  }
+
+  size_t read_count = 0;
+  int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+
+  while (read_count < length) {
+    int64_t remaining = deadline - esp_timer_get_time();
+    if (remaining <= 0) {
+      break;
+    }
+
+    pollfd waiting = {socket->fd, POLLIN, 0};
+    if (poll(&waiting, 1, (int)((remaining + 999) / 1000)) <= 0) {
+      continue;
+    }
+
+    ssize_t received = recv(socket->fd, buffer + read_count, length - read_count, 0);
+    if (received <= 0) {
+      break;
+    }
+    read_count += received;
+  }
+  return read_count;
+}
+
+size_t WiFiClient::write(const uint8_t *buffer, size_t length) {
+  if (!socket || socket->fd < 0) {
+    return 0;
+  }
+
+  size_t written = 0;
+  while (written < length) {
+    ssize_t sent = send(socket->fd, buffer + written, length - written, MSG_NOSIGNAL);
+    if (sent <= 0) {
+      break;
+    }
+    written += sent;
+  }
+  return written;
+}
+
+void WiFiClient::setTimeout(unsigned long timeout_ms) {
+  this->timeout_ms = timeout_ms;
+}
+
+void WiFiClient::stop() {
+  if (socket && socket->fd >= 0) {
+    close(socket->fd);
+    socket->fd = -1;
+  }
+}
+
+WiFiClient::operator bool() {
+  return socket && socket->fd >= 0;
+}
+
+WiFiServer::WiFiServer(uint16_t port) : port(port) {}
+
+void WiFiServer::begin() {
+  if (wifi_server_port != 0) {
+    port = wifi_server_port;
+  }
+
+  fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  int enable = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if (bind(fd, (sockaddr *)&address, sizeof(address)) < 0 || listen(fd, 16) < 0) {
+    perror("loadtest: unable to listen");
+    exit(1);
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+WiFiClient WiFiServer::accept() {
+  int client_fd = ::accept(fd, NULL, NULL);
+  if (client_fd < 0) {
+    return WiFiClient();
+  }
+  int enable = 1;
+  setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+  return WiFiClient(client_fd);
+}
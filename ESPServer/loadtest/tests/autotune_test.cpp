@@ -0,0 +1,110 @@
+/*
+
+Host test of the relay autotuner and its status payload. The relay is run
+against a delayed integrator, whose limit cycle has a known amplitude and
+period, and the experiment must abort on excess tilt and on cancel. Every
+status must survive an encode/decode round trip.
+
+*/
+
+#include "autotune.h"
+#include "check.h"
+
+#include <math.h>
+
+#define TIME_STEP 0.001f       // s
+#define PLANT_GAIN 100.0f      // degrees per second per rad/s of output
+#define PLANT_DELAY_STEPS 50   // samples between output and its effect
+#define RELAY_AMPLITUDE 1.0f   // rad/s
+
+/// @brief runs an experiment against e' = -K u(t - L), starting from a
+/// small tilt. A relay of amplitude d drives it into a cycle of period 4L
+/// and amplitude K d L, so Ku = 4 / (pi K L) and Tu = 4L
+/// @param disturbance added to the tilt every sample, in degrees
+void run_experiment(Autotuner *tuner, float disturbance) {
+  float delayed[PLANT_DELAY_STEPS] = {};
+  float error = 0.5f;
+  uint32_t samples = 0;
+
+  autotune_start(tuner, RELAY_AMPLITUDE, 0, 30, 10);
+  while (tuner->state == AutotuneRunning) {
+    float output = autotune_step(tuner, error, TIME_STEP);
+    uint32_t slot = samples % PLANT_DELAY_STEPS;
+    error += -PLANT_GAIN * delayed[slot] * TIME_STEP + disturbance;
+    delayed[slot] = output;
+    samples++;
+  }
+}
+
+void check_relay_experiment() {
+  Autotuner tuner;
+  run_experiment(&tuner, 0);
+
+  float delay = PLANT_DELAY_STEPS * TIME_STEP;
+  float expected_gain = 4 / ((float)M_PI * PLANT_GAIN * delay);
+  float expected_period = 4 * delay;
+  printf("autotune: Ku %.5f (expected %.5f), Tu %.4f s (expected %.4f s)\n", tuner.ultimate_gain, expected_gain,
+         tuner.ultimate_period, expected_period);
+
+  CHECK(tuner.state == AutotuneDone, "experiment must finish, ended in state %d reason %d", tuner.state,
+        tuner.abort_reason);
+  CHECK(fabsf(tuner.ultimate_period - expected_period) < 0.05f * expected_period, "Tu %.4f s, expected %.4f s",
+        tuner.ultimate_period, expected_period);
+  CHECK(fabsf(tuner.ultimate_gain - expected_gain) < 0.1f * expected_gain, "Ku %.5f, expected %.5f",
+        tuner.ultimate_gain, expected_gain);
+  CHECK(fabsf(tuner.kp - 0.6f * tuner.ultimate_gain) < 1E-6f, "Kp must be 0.6 Ku");
+  CHECK(fabsf(tuner.mean_sample_time - TIME_STEP) < 1E-6f, "mean sample time %.6f", tuner.mean_sample_time);
+  CHECK(autotune_step(&tuner, 1, TIME_STEP) == 0, "a finished experiment must output zero");
+}
+
+void check_aborts() {
+  Autotuner tuner;
+  run_experiment(&tuner, 0.2f); // faster than the relay can correct
+  CHECK(tuner.state == AutotuneAborted && tuner.abort_reason == AbortTilt, "runaway tilt must abort, got %d/%d",
+        tuner.state, tuner.abort_reason);
+
+  autotune_start(&tuner, -RELAY_AMPLITUDE, 0, 30, 10);
+  CHECK(tuner.relay_amplitude == RELAY_AMPLITUDE, "relay amplitude must be positive");
+  autotune_step(&tuner, 1, TIME_STEP);
+  autotune_cancel(&tuner);
+  CHECK(tuner.state == AutotuneAborted && tuner.abort_reason == AbortCancelled, "cancel must abort");
+  CHECK(autotune_step(&tuner, 1, TIME_STEP) == 0, "a cancelled experiment must output zero");
+
+  autotune_start(&tuner, RELAY_AMPLITUDE, 0, 30, 0.5f);
+  for (int i = 0; i < 1000 && tuner.state == AutotuneRunning; i++) {
+    autotune_step(&tuner, 0.1f, TIME_STEP); // never crosses, so never cycles
+  }
+  CHECK(tuner.state == AutotuneAborted && tuner.abort_reason == AbortTimeout, "no oscillation must time out");
+}
+
+void check_status() {
+  AutotuneStatus statuses[] = {
+    {AutotuneIdle, AbortNone, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+    {AutotuneDone, AbortNone, 6, 3.25f, 4.5f, 0.2f, 0.0025f, 0.2f, 300, 48, 5},
+    {AutotuneAborted, AbortTilt, 2, 1.5f, -1, -0.5f, 1E6f, 1E-6f, -32768, -1, 32767},
+  };
+
+  for (const AutotuneStatus &status : statuses) {
+    uint8_t buffer[AUTOTUNE_STATUS_LENGTH];
+    CHECK(encode_autotune_status(&status, buffer) == AUTOTUNE_STATUS_LENGTH, "status length");
+
+    AutotuneStatus decoded;
+    CHECK(decode_autotune_status(buffer, sizeof(buffer), &decoded), "status must decode");
+    CHECK(decoded.state == status.state && decoded.abort_reason == status.abort_reason &&
+              decoded.cycles == status.cycles && decoded.elapsed == status.elapsed &&
+              decoded.amplitude == status.amplitude && decoded.period == status.period &&
+              decoded.ultimate_gain == status.ultimate_gain && decoded.ultimate_period == status.ultimate_period &&
+              decoded.proportional == status.proportional && decoded.integral == status.integral &&
+              decoded.derivative == status.derivative,
+          "status in state %u round trip", status.state);
+
+    CHECK(!decode_autotune_status(buffer, sizeof(buffer) - 1, &decoded), "short status must be rejected");
+  }
+}
+
+int main() {
+  check_relay_experiment();
+  check_aborts();
+  check_status();
+  return check_summary("autotune_test");
+}
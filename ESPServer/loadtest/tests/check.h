@@ -0,0 +1,37 @@
+/*
+
+A minimal check harness for the host unit tests. CHECK records a failure
+and keeps going so a single run reports every broken case; check_summary
+prints the tally and gives the process exit code.
+
+*/
+
+#ifndef CHECK_HARNESS
+
+#define CHECK_HARNESS
+
+#include <stdio.h>
+
+static int checks_run = 0;
+static int checks_failed = 0;
+
+#define CHECK(condition, ...)                                     \
+  do {                                                            \
+    checks_run++;                                                 \
+    if (!(condition)) {                                           \
+      checks_failed++;                                            \
+      printf("FAIL %s:%d: %s: ", __FILE__, __LINE__, #condition); \
+      printf(__VA_ARGS__);                                        \
+      printf("\n");                                               \
+    }                                                             \
+  } while (0)
+
+/// @brief prints the tally of checks
+/// @param name the name of the test binary
+/// @return the process exit code
+static int check_summary(const char *name) {
+  printf("%s: %d checks, %d failed\n", name, checks_run, checks_failed);
+  return checks_failed == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,197 @@
+/*
+
+Host rig comparing the balance controllers on identical inputs. Each
+controller is run through the Controller interface against a simulated
+wheeled inverted pendulum: the model the LQR gains were designed on (see
+profile.h), integrated with the full nonlinear tilt dynamics. Every
+controller starts from the same state and sees the same sequence of
+disturbances, and the rig prints how each one settles.
+
+*/
+
+#include "controller.h"
+#include "profile.h"
+#include "check.h"
+
+#include <math.h>
+#include <memory>
+
+#define GRAVITY 9.81
+#define PENDULUM_LENGTH 0.10 // m, axle to centre of mass
+#define WHEEL_RADIUS 0.04    // m
+#define CONTROL_PERIOD 0.025 // s, GYRO_POLL_DELAY
+#define SUBSTEPS 25
+#define SIMULATED_SECONDS 10.0
+#define FALLEN_TILT 45.0  // degrees
+#define SETTLED_TILT 0.5  // degrees
+
+/// @brief the gains the Rust client uploads on connect
+struct RigGains {
+  int16_t proportional;
+  int16_t derivative;
+  int16_t integral;
+};
+
+static const RigGains DEFAULT_GAINS = {300, 5, 48};
+
+struct Plant {
+  double tilt;           // rad
+  double tilt_rate;      // rad/s
+  double wheel_position; // rad
+  double wheel_velocity; // rad/s
+};
+
+/// @brief advances the plant by one control period while the wheels ramp to
+/// the commanded velocity
+/// @param push an external tilt acceleration, in rad/s^2
+void step_plant(Plant *plant, double command, double push) {
+  double dt = CONTROL_PERIOD / SUBSTEPS;
+  double wheel_acceleration = (command - plant->wheel_velocity) / CONTROL_PERIOD;
+
+  for (int i = 0; i < SUBSTEPS; i++) {
+    double tilt_acceleration = (GRAVITY * sin(plant->tilt) -
+                                WHEEL_RADIUS * wheel_acceleration * cos(plant->tilt)) /
+                                 PENDULUM_LENGTH +
+                               push;
+    plant->tilt_rate += tilt_acceleration * dt;
+    plant->tilt += plant->tilt_rate * dt;
+    plant->wheel_velocity += wheel_acceleration * dt;
+    plant->wheel_position += plant->wheel_velocity * dt;
+  }
+  plant->wheel_velocity = command;
+}
+
+struct RunResult {
+  bool fell;
+  double settle_time;   // s; the last time |tilt| exceeded SETTLED_TILT
+  double peak_tilt;     // degrees
+  double peak_velocity; // rad/s
+  double final_velocity;
+  double final_tilt;
+};
+
+/// @brief runs one controller in closed loop from an initial tilt
+/// @param velocity_target the drive command fed forward, in rad/s
+/// @param push_at when to apply a one-period push, in s; negative for none
+RunResult run_closed_loop(Controller *controller, double initial_tilt, double velocity_target, double push_at) {
+  Plant plant = {initial_tilt * M_PI / 180, 0, 0, 0};
+  RunResult result = {false, 0, 0, 0, 0, 0};
+
+  ControllerInput input = {initial_tilt, 0, 0, 0, velocity_target, CONTROL_PERIOD};
+  controller->reset(input);
+
+  int periods = (int)(SIMULATED_SECONDS / CONTROL_PERIOD);
+  for (int i = 0; i < periods; i++) {
+    double time = i * CONTROL_PERIOD;
+    input.tilt = plant.tilt * 180 / M_PI;
+    input.tilt_rate = plant.tilt_rate * 180 / M_PI;
+    input.wheel_position = plant.wheel_position;
+    input.wheel_velocity = plant.wheel_velocity;
+
+    double command = controller->update(input);
+    double push = (push_at >= 0 && fabs(time - push_at) < CONTROL_PERIOD / 2) ? 40.0 : 0.0;
+    step_plant(&plant, command, push);
+
+    double tilt = fabs(plant.tilt * 180 / M_PI);
+    if (tilt > FALLEN_TILT) {
+      result.fell = true;
+      return result;
+    }
+    if (tilt > SETTLED_TILT) {
+      result.settle_time = time + CONTROL_PERIOD;
+    }
+    result.peak_tilt = fmax(result.peak_tilt, tilt);
+    result.peak_velocity = fmax(result.peak_velocity, fabs(command));
+  }
+
+  result.final_velocity = plant.wheel_velocity;
+  result.final_tilt = plant.tilt * 180 / M_PI;
+  return result;
+}
+
+void print_result(const char *name, const char *scenario, const RunResult &result) {
+  if (result.fell) {
+    printf("%-4s %-20s fell\n", name, scenario);
+    return;
+  }
+  char settle[16];
+  if (result.settle_time >= SIMULATED_SECONDS - CONTROL_PERIOD) {
+    snprintf(settle, sizeof(settle), "never");
+  } else {
+    snprintf(settle, sizeof(settle), "%.2f s", result.settle_time);
+  }
+  printf("%-4s %-20s settle %-7s  peak tilt %5.2f deg  peak wheel %5.1f rad/s  final wheel %6.2f rad/s\n",
+         name, scenario, settle, result.peak_tilt, result.peak_velocity, result.final_velocity);
+}
+
+/// @brief feeds one open-loop input sequence to every controller; each must
+/// push the wheels under a lean, and respond identically to a repeat run
+void check_identical_inputs(Controller **controllers, const char **names, int count) {
+  for (int c = 0; c < count; c++) {
+    ControllerInput input = {0, 0, 0, 0, 0, CONTROL_PERIOD};
+    controllers[c]->reset(input);
+
+    double first_run[40];
+    for (int pass = 0; pass < 2; pass++) {
+      controllers[c]->reset(input);
+      for (int i = 0; i < 40; i++) {
+        ControllerInput step = {2.0 * sin(i * 0.3), 2.0 * 0.3 / CONTROL_PERIOD * cos(i * 0.3), 0, 0, 0, CONTROL_PERIOD};
+        double output = controllers[c]->update(step);
+        if (pass == 0) {
+          first_run[i] = output;
+        } else {
+          CHECK(output == first_run[i], "%s: step %d differs after reset", names[c], i);
+        }
+      }
+    }
+
+    ControllerInput lean = {3, 0, 0, 0, 0, CONTROL_PERIOD};
+    controllers[c]->reset(lean);
+    CHECK(controllers[c]->update(lean) > 0, "%s: a forward lean must drive the wheels forward", names[c]);
+    lean.tilt = -3;
+    controllers[c]->reset(lean);
+    CHECK(controllers[c]->update(lean) < 0, "%s: a backward lean must drive the wheels backward", names[c]);
+  }
+}
+
+int main() {
+  RigGains gains = DEFAULT_GAINS;
+
+  // owned through the interface, as telemetry_loop holds them
+  std::unique_ptr<Controller> pid(new PidController<FranklinProfile, RigGains>(&gains));
+  std::unique_ptr<Controller> lqr(new LqrController<FranklinProfile>());
+  Controller *controllers[] = {pid.get(), lqr.get()};
+  const char *names[] = {"pid", "lqr"};
+
+  check_identical_inputs(controllers, names, 2);
+
+  double initial_tilts[] = {2, 5, 10};
+  for (double tilt : initial_tilts) {
+    char scenario[32];
+    snprintf(scenario, sizeof(scenario), "from %.0f deg", tilt);
+    for (int c = 0; c < 2; c++) {
+      RunResult result = run_closed_loop(controllers[c], tilt, 0, -1);
+      print_result(names[c], scenario, result);
+      CHECK(!result.fell, "%s fell %s", names[c], scenario);
+    }
+  }
+
+  for (int c = 0; c < 2; c++) {
+    RunResult result = run_closed_loop(controllers[c], 0, 0, 2.0);
+    print_result(names[c], "push at 2 s", result);
+    CHECK(!result.fell, "%s fell after a push", names[c]);
+  }
+
+  // only the LQR feeds the velocity target forward
+  RunResult driving = run_closed_loop(lqr.get(), 0, 3.0, -1);
+  print_result("lqr", "driving at 3 rad/s", driving);
+  CHECK(!driving.fell, "lqr fell while driving");
+  CHECK(fabs(driving.final_velocity - 3.0) < 0.1, "lqr must track the velocity target; %.2f rad/s",
+        driving.final_velocity);
+  CHECK(fabs(driving.final_tilt) < SETTLED_TILT, "lqr must drive upright; %.2f deg", driving.final_tilt);
+
+  RunResult lqr_settle = run_closed_loop(lqr.get(), 5, 0, -1);
+  CHECK(lqr_settle.settle_time < 3, "lqr must settle from 5 deg within 3 s; %.2f s", lqr_settle.settle_time);
+
+  return check_summary("controller_test");
+}
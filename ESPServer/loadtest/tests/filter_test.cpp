@@ -0,0 +1,168 @@
+/*
+
+Host test of the biquad designs. Each design is driven with sine waves and
+its measured magnitude response is checked at DC, at the cutoff or centre,
+and in the stopband. Newly enabled stages must start from their steady
+state, and a timing loop reports the cost of a full bank per sample.
+
+*/
+
+#include "filter.h"
+#include "check.h"
+
+#include <math.h>
+#include <time.h>
+
+#define SAMPLE_RATE 40.0f // the nominal telemetry loop rate
+#define SETTLE_SAMPLES 4000
+#define MEASURE_SAMPLES 40000
+#define BENCHMARK_SAMPLES 1000000
+
+volatile float benchmark_sink; // keeps the timing loop from being optimised out
+
+/// @brief measures the gain of a bank at one frequency by correlating its
+/// settled output against the input sine
+/// @return the gain in dB
+double measure_gain(const FilterBank *bank, double frequency) {
+  BiquadState states[BIQUAD_MAX_STAGES] = {};
+
+  // DC has no quadrature reference; the settled step response is the gain
+  if (frequency == 0) {
+    float output = 0;
+    for (int i = 0; i < SETTLE_SAMPLES; i++) {
+      output = filter_bank_run(bank, states, 1.0f);
+    }
+    return 20 * log10(fabs(output));
+  }
+
+  double in_phase = 0;
+  double quadrature = 0;
+
+  for (int i = 0; i < SETTLE_SAMPLES + MEASURE_SAMPLES; i++) {
+    double phase = 2 * M_PI * frequency * i / bank->sample_rate;
+    double output = filter_bank_run(bank, states, (float)sin(phase));
+    if (i >= SETTLE_SAMPLES) {
+      in_phase += output * sin(phase);
+      quadrature += output * cos(phase);
+    }
+  }
+
+  double amplitude = 2 * sqrt(in_phase * in_phase + quadrature * quadrature) / MEASURE_SAMPLES;
+  return 20 * log10(amplitude);
+}
+
+/// @brief a bank with a single configured stage
+FilterBank single_stage(BiquadType type, float frequency, float quality) {
+  FilterBank bank;
+  filter_bank_init(&bank, SAMPLE_RATE);
+  filter_bank_configure(&bank, 0, BiquadConfig{type, frequency, quality});
+  return bank;
+}
+
+void check_low_pass() {
+  float cutoffs[] = {2, 5, 10, 15};
+  for (float cutoff : cutoffs) {
+    FilterBank bank = single_stage(BiquadLowPass, cutoff, 0.7071f);
+
+    double dc = measure_gain(&bank, 0);
+    double at_cutoff = measure_gain(&bank, cutoff);
+    double stopband = measure_gain(&bank, SAMPLE_RATE / 2 * 0.95);
+
+    CHECK(fabs(dc) < 0.01, "low-pass %.0f Hz: DC gain %.2f dB", cutoff, dc);
+    CHECK(fabs(at_cutoff + 3.01) < 0.1, "low-pass %.0f Hz: %.2f dB at cutoff", cutoff, at_cutoff);
+    CHECK(stopband < -20, "low-pass %.0f Hz: %.2f dB near nyquist", cutoff, stopband);
+
+    // a Butterworth rolls off at 12 dB per octave above the cutoff
+    if (cutoff * 2 < SAMPLE_RATE / 2) {
+      double octave = measure_gain(&bank, cutoff * 2);
+      CHECK(octave < -11, "low-pass %.0f Hz: %.2f dB an octave up", cutoff, octave);
+    }
+    printf("low-pass %4.1f Hz: DC %6.2f dB, cutoff %6.2f dB, %4.1f Hz %7.2f dB\n", cutoff, dc, at_cutoff,
+           SAMPLE_RATE / 2 * 0.95, stopband);
+  }
+}
+
+void check_notch() {
+  float centres[] = {4, 8, 12};
+  float quality = 2;
+  for (float centre : centres) {
+    FilterBank bank = single_stage(BiquadNotch, centre, quality);
+
+    double dc = measure_gain(&bank, 0);
+    double at_centre = measure_gain(&bank, centre);
+    double far = measure_gain(&bank, centre < SAMPLE_RATE / 4 ? SAMPLE_RATE / 2 * 0.95 : 0.5);
+
+    CHECK(fabs(dc) < 0.01, "notch %.0f Hz: DC gain %.2f dB", centre, dc);
+    CHECK(at_centre < -40, "notch %.0f Hz: %.2f dB at centre", centre, at_centre);
+    CHECK(far > -1, "notch %.0f Hz: %.2f dB away from the notch", centre, far);
+    printf("notch    %4.1f Hz: DC %6.2f dB, centre %7.2f dB, far %6.2f dB\n", centre, dc, at_centre, far);
+  }
+}
+
+void check_design_limits() {
+  FilterBank bank = single_stage(BiquadLowPass, SAMPLE_RATE / 2, 0.7071f);
+  CHECK(fabs(measure_gain(&bank, 5)) < 0.01, "a cutoff at nyquist must bypass the stage");
+
+  // redesigning at a slower measured rate moves the cutoff with it
+  bank = single_stage(BiquadLowPass, 5, 0.7071f);
+  filter_bank_set_rate(&bank, 32);
+  double at_cutoff = measure_gain(&bank, 5);
+  CHECK(fabs(at_cutoff + 3.01) < 0.1, "cutoff after a rate change: %.2f dB", at_cutoff);
+}
+
+void check_priming() {
+  // an accelerometer low-pass enabled while the axis reads 1 g
+  FilterBank bank;
+  filter_bank_init(&bank, SAMPLE_RATE);
+  BiquadState states[BIQUAD_MAX_STAGES] = {};
+  for (int i = 0; i < 100; i++) {
+    filter_bank_run(&bank, states, 1.0f);
+  }
+
+  filter_bank_configure(&bank, 0, BiquadConfig{BiquadLowPass, 2, 0.7071f});
+  filter_bank_configure(&bank, 1, BiquadConfig{BiquadNotch, 8, 2});
+  float worst = 0;
+  for (int i = 0; i < 100; i++) {
+    float error = fabsf(filter_bank_run(&bank, states, 1.0f) - 1.0f);
+    worst = error > worst ? error : worst;
+  }
+  CHECK(worst < 1e-5, "an enabled stage must start at its steady state; error %g", worst);
+
+  // disabling then re-enabling primes again rather than reusing stale state
+  filter_bank_configure(&bank, 0, BiquadConfig{BiquadNone, 0, 0});
+  for (int i = 0; i < 100; i++) {
+    filter_bank_run(&bank, states, -1.0f);
+  }
+  filter_bank_configure(&bank, 0, BiquadConfig{BiquadLowPass, 2, 0.7071f});
+  float output = filter_bank_run(&bank, states, -1.0f);
+  CHECK(fabsf(output + 1.0f) < 1e-5, "a re-enabled stage must be primed; output %g", output);
+}
+
+void benchmark() {
+  FilterBank bank;
+  filter_bank_init(&bank, SAMPLE_RATE);
+  for (uint8_t i = 0; i < BIQUAD_MAX_STAGES; i++) {
+    filter_bank_configure(&bank, i, BiquadConfig{i % 2 ? BiquadNotch : BiquadLowPass, 3.0f + 4 * i, 0.9f});
+  }
+
+  BiquadState states[BIQUAD_MAX_STAGES] = {};
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < BENCHMARK_SAMPLES; i++) {
+    benchmark_sink = filter_bank_run(&bank, states, (float)(i & 0xFF));
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double nanos = (end.tv_sec - start.tv_sec) * 1E9 + (end.tv_nsec - start.tv_nsec);
+  printf("benchmark: %d stage bank, %.1f ns per sample on the host\n", BIQUAD_MAX_STAGES,
+         nanos / BENCHMARK_SAMPLES);
+}
+
+int main() {
+  check_low_pass();
+  check_notch();
+  check_design_limits();
+  check_priming();
+  benchmark();
+  return check_summary("filter_test");
+}
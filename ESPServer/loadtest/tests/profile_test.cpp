@@ -0,0 +1,68 @@
+/*
+
+Host test run once per robot profile. Each profile must reach its top
+speed without saturating the step tick, produce the step count its
+constants imply at every speed, and use distinct pins.
+
+*/
+
+#include "stepper.h"
+#include "check.h"
+
+#include <math.h>
+
+#define TEST_TICKS 1000000 // 20 s at STEP_TICK_MICROS
+
+/// @brief runs the profile's conversion and accumulator at one speed
+/// @return the number of steps emitted over TEST_TICKS
+template <typename Profile>
+uint32_t steps_at(double angular_velocity) {
+  PhaseAccumulator acc = {0, 0, false};
+  set_accumulator_target<Profile>(&acc, angular_velocity);
+
+  uint32_t steps = 0;
+  for (uint32_t i = 0; i < TEST_TICKS; i++) {
+    if (advance_accumulator(&acc)) {
+      steps++;
+    }
+  }
+  return steps;
+}
+
+template <typename Profile>
+void check_profile(const char *name) {
+  CHECK(max_step_rate<Profile>() * STEP_TICK_MICROS < 1E6, "%s: top speed needs more than one step per tick", name);
+  CHECK(angular_vel_to_phase_increment<Profile>(Profile::max_angular_velocity) < UINT32_MAX,
+        "%s: top speed saturates the accumulator", name);
+
+  double seconds = (double)TEST_TICKS * STEP_TICK_MICROS / 1E6;
+  double speeds[] = {0.05, 1, 10, -25, Profile::max_angular_velocity};
+  for (double speed : speeds) {
+    double expected = fabs(speed) * Profile::steps_per_rev / (2 * M_PI) * seconds;
+    uint32_t steps = steps_at<Profile>(speed);
+    CHECK(fabs(steps - expected) <= 1, "%s: %.2f rad/s gave %u steps, expected %.1f", name, speed, steps, expected);
+  }
+
+  uint8_t pins[] = {Profile::dir_pin_1, Profile::dir_pin_2, Profile::step_pin_1, Profile::step_pin_2,
+                    Profile::aux_power_1};
+  for (uint8_t i = 0; i < sizeof(pins); i++) {
+    for (uint8_t j = i + 1; j < sizeof(pins); j++) {
+      CHECK(pins[i] != pins[j], "%s: pin %u is assigned twice", name, pins[i]);
+    }
+  }
+
+  printf("%s: %u steps/rev, top speed %.0f rad/s = %.0f steps/s\n", name, (unsigned)Profile::steps_per_rev,
+         Profile::max_angular_velocity, max_step_rate<Profile>());
+}
+
+int main() {
+  check_profile<FranklinProfile>("FranklinProfile");
+  check_profile<FranklinEighthStepProfile>("FranklinEighthStepProfile");
+
+  // the eighth-step chassis covers the same distance in half the steps
+  int64_t difference = (int64_t)steps_at<FranklinEighthStepProfile>(10) * 2 - steps_at<FranklinProfile>(10);
+  CHECK(difference >= -2 && difference <= 2,
+        "eighth stepping must halve the step count");
+
+  return check_summary("profile_test");
+}
@@ -0,0 +1,158 @@
+/*
+
+Host test of the wire protocol codec: every encoder is checked against its
+decoder, and corrupted or truncated input must be rejected.
+
+*/
+
+#include "protocol.h"
+#include "check.h"
+
+#include <string.h>
+
+void check_integers() {
+  uint8_t buffer[8];
+
+  put_u16(0xBEEF, buffer);
+  CHECK(buffer[0] == 0xBE && buffer[1] == 0xEF, "u16 must be big endian");
+  CHECK(get_u16(buffer) == 0xBEEF, "u16 round trip");
+
+  put_u32(0xDEADBEEF, buffer);
+  CHECK(get_u32(buffer) == 0xDEADBEEF, "u32 round trip");
+
+  put_u64(0x0123456789ABCDEFull, buffer);
+  CHECK(get_u64(buffer) == 0x0123456789ABCDEFull, "u64 round trip");
+
+  float values[] = {0.0f, -1.5f, 3.14159f, 1e-20f, -65504.0f};
+  for (float value : values) {
+    put_f32(value, buffer);
+    CHECK(get_f32(buffer) == value, "f32 round trip of %g", value);
+  }
+}
+
+void check_crc() {
+  const char *check_string = "123456789";
+  CHECK(crc16((const uint8_t *)check_string, 9) == 0x29B1, "CRC-16/CCITT-FALSE check value");
+
+  // a crc continued over two halves matches the crc of the whole
+  uint16_t split = crc16_update(crc16((const uint8_t *)check_string, 4), (const uint8_t *)check_string + 4, 5);
+  CHECK(split == 0x29B1, "crc16_update must continue a crc");
+}
+
+void check_varints() {
+  uint32_t values[] = {0, 1, 127, 128, 300, 16383, 16384, MAX_PAYLOAD_LENGTH, 0x0FFFFFFF, UINT32_MAX};
+  for (uint32_t value : values) {
+    uint8_t buffer[VARINT_MAX_LENGTH];
+    size_t length = varint_encode(value, buffer);
+    CHECK(length >= 1 && length <= VARINT_MAX_LENGTH, "varint %u length %zu", value, length);
+
+    uint32_t decoded = 0;
+    CHECK(varint_decode(buffer, length, &decoded) == length && decoded == value, "varint %u round trip", value);
+
+    // every strict prefix is incomplete
+    for (size_t prefix = 0; prefix < length; prefix++) {
+      CHECK(varint_decode(buffer, prefix, &decoded) == 0, "varint %u prefix %zu must be incomplete", value, prefix);
+    }
+  }
+
+  uint8_t overflow[] = {0x80, 0x80, 0x80, 0x80, 0x80, 0x01};
+  uint32_t decoded;
+  CHECK(varint_decode(overflow, sizeof(overflow), &decoded) == 0, "varint overflow must be rejected");
+
+  // a fifth byte may only carry bits 28 to 31
+  uint8_t wide[] = {0x80, 0x80, 0x80, 0x80, 0x10};
+  CHECK(varint_decode(wide, sizeof(wide), &decoded) == 0, "varint wider than 32 bits must be rejected");
+  uint8_t widest[] = {0xFF, 0xFF, 0xFF, 0xFF, 0x0F};
+  CHECK(varint_decode(widest, sizeof(widest), &decoded) == sizeof(widest) && decoded == 0xFFFFFFFF,
+        "varint of UINT32_MAX must decode");
+}
+
+void check_v1_header() {
+  uint8_t header[V1_HEADER_LENGTH];
+  CHECK(encode_v1_header(OpStatusPoll, 0x0102, header) == V1_HEADER_LENGTH, "v1 header length");
+  uint8_t expected[] = {HEADER_BYTE, HEADER_BYTE, OpStatusPoll, 0x01, 0x02};
+  CHECK(memcmp(header, expected, sizeof(expected)) == 0, "v1 header layout");
+}
+
+void check_v2_frames() {
+  size_t lengths[] = {0, 1, 127, 128, MAX_PAYLOAD_LENGTH};
+  for (size_t length : lengths) {
+    uint8_t payload[MAX_PAYLOAD_LENGTH];
+    for (size_t i = 0; i < length; i++) {
+      payload[i] = (uint8_t)(i * 31 + 7);
+    }
+
+    uint8_t frame[V2_MAX_HEADER_LENGTH + MAX_PAYLOAD_LENGTH + V2_CRC_LENGTH];
+    size_t frame_length = encode_v2_frame(OpEcho, payload, length, frame, sizeof(frame));
+    CHECK(frame_length > length, "payload %zu must encode", length);
+
+    uint8_t operation = 0;
+    const uint8_t *decoded = NULL;
+    uint32_t decoded_length = 0;
+    CHECK(decode_v2_frame(frame, frame_length, &operation, &decoded, &decoded_length) == frame_length,
+          "payload %zu must decode", length);
+    CHECK(operation == OpEcho && decoded_length == length, "payload %zu header round trip", length);
+    CHECK(length == 0 || memcmp(decoded, payload, length) == 0, "payload %zu body round trip", length);
+
+    // truncation and any single flipped bit after the header bytes fail
+    CHECK(decode_v2_frame(frame, frame_length - 1, &operation, &decoded, &decoded_length) == 0,
+          "payload %zu truncated frame must be rejected", length);
+    for (size_t i = 2; i < frame_length; i += 1 + frame_length / 16) {
+      frame[i] ^= 0x10;
+      CHECK(decode_v2_frame(frame, frame_length, &operation, &decoded, &decoded_length) == 0,
+            "payload %zu corrupt byte %zu must be rejected", length, i);
+      frame[i] ^= 0x10;
+    }
+
+    CHECK(encode_v2_frame(OpEcho, payload, length, frame, frame_length - 1) == 0,
+          "payload %zu must not overrun a short buffer", length);
+  }
+}
+
+void check_status() {
+  StatusSnapshot status = {-120, 45, 32000, true, -2.5f, 12.75f, 99.125f, -0.0625f};
+
+  for (uint32_t mask = 0; mask <= STATUS_MASK_ALL; mask++) {
+    uint8_t buffer[VARINT_MAX_LENGTH + StatusFieldCount * 5];
+    size_t length = encode_status_v2(&status, mask, buffer, sizeof(buffer));
+    CHECK(length == status_v2_length(mask), "mask %02x length", mask);
+
+    StatusSnapshot decoded;
+    memset(&decoded, 0, sizeof(decoded));
+    uint32_t decoded_mask = 0;
+    CHECK(decode_status_v2(buffer, length, &decoded, &decoded_mask), "mask %02x must decode", mask);
+    CHECK(decoded_mask == mask, "mask %02x round trip", mask);
+
+    bool fields_match =
+      (!(mask & (1u << FieldPidProportional)) || decoded.pid_proportional == status.pid_proportional) &&
+      (!(mask & (1u << FieldPidIntegral)) || decoded.pid_integral == status.pid_integral) &&
+      (!(mask & (1u << FieldPidDerivative)) || decoded.pid_derivative == status.pid_derivative) &&
+      (!(mask & (1u << FieldMotorsEnabled)) || decoded.motors_enabled == status.motors_enabled) &&
+      (!(mask & (1u << FieldGyroOffset)) || decoded.gyro_offset == status.gyro_offset) &&
+      (!(mask & (1u << FieldGyroValue)) || decoded.gyro_value == status.gyro_value) &&
+      (!(mask & (1u << FieldIntegralSum)) || decoded.integral_sum == status.integral_sum) &&
+      (!(mask & (1u << FieldMotorTarget)) || decoded.motor_target == status.motor_target);
+    CHECK(fields_match, "mask %02x field values", mask);
+
+    if (length > 1) {
+      CHECK(!decode_status_v2(buffer, length - 1, &decoded, &decoded_mask), "mask %02x truncated", mask);
+    }
+  }
+
+  uint8_t unknown_field[VARINT_MAX_LENGTH];
+  size_t unknown_length = varint_encode(1u << StatusFieldCount, unknown_field);
+  StatusSnapshot decoded;
+  uint32_t decoded_mask;
+  CHECK(!decode_status_v2(unknown_field, unknown_length, &decoded, &decoded_mask),
+        "unknown fields must be rejected");
+}
+
+int main() {
+  check_integers();
+  check_crc();
+  check_varints();
+  check_v1_header();
+  check_v2_frames();
+  check_status();
+  return check_summary("protocol_test");
+}
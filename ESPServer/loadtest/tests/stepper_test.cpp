@@ -0,0 +1,70 @@
+/*
+
+Host test of the stepper phase accumulator. Each case runs an accumulator
+for a fixed number of ticks and checks the step count is within one step
+of the ideal count for the requested rate.
+
+*/
+
+#include "stepper.h"
+#include "check.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#define TEST_TICKS 1000000 // 20 s at STEP_TICK_MICROS
+
+/// @brief runs an accumulator from phase 0
+/// @param increment the phase added each tick
+/// @param ticks the number of ticks to run
+/// @return the number of steps emitted
+uint32_t count_steps(uint32_t increment, uint32_t ticks) {
+  PhaseAccumulator acc = {0, increment, false};
+  uint32_t steps = 0;
+  for (uint32_t i = 0; i < ticks; i++) {
+    if (advance_accumulator(&acc)) {
+      steps++;
+    }
+  }
+  return steps;
+}
+
+/// @brief checks a target angular velocity produces its ideal step count
+/// @param angular_velocity the target, in rad/s
+void check_rate(double angular_velocity) {
+  PhaseAccumulator acc = {0, 0, false};
+  set_accumulator_target<FranklinProfile>(&acc, angular_velocity);
+
+  double seconds = (double)TEST_TICKS * STEP_TICK_MICROS / 1E6;
+  double expected = fabs(angular_velocity) * FranklinProfile::steps_per_rev / (2 * M_PI) * seconds;
+  uint32_t steps = count_steps(acc.increment, TEST_TICKS);
+
+  CHECK(fabs(steps - expected) <= 1, "%.3f rad/s: %u steps, expected %.1f", angular_velocity, steps, expected);
+  CHECK(acc.reverse == (angular_velocity < 0), "%.3f rad/s: wrong direction", angular_velocity);
+}
+
+int main() {
+  double rates[] = {0, 0.001, 0.37, 1, -1, 12.5, -33.3, FranklinProfile::max_angular_velocity};
+  for (double rate : rates) {
+    check_rate(rate);
+  }
+
+  // raw increments around the top of the range
+  CHECK(count_steps(UINT32_MAX, TEST_TICKS) == TEST_TICKS, "saturated rate must step every tick");
+  CHECK(count_steps(UINT32_MAX, 1) == 1, "saturated rate must step on the first tick");
+  uint32_t near_top = count_steps(UINT32_MAX - 1, TEST_TICKS);
+  CHECK(near_top >= TEST_TICKS - 1, "UINT32_MAX - 1: %u steps", near_top);
+  CHECK(count_steps(0x80000000u, TEST_TICKS) == TEST_TICKS / 2, "half rate");
+  CHECK(count_steps(1, TEST_TICKS) == 0, "slowest rate");
+
+  // past one step per tick the increment saturates instead of wrapping
+  CHECK(angular_vel_to_phase_increment<FranklinProfile>(1E6) == UINT32_MAX, "overspeed must saturate");
+
+  // both accumulators share the tick
+  PhaseAccumulator acc_1 = {0, UINT32_MAX, false};
+  PhaseAccumulator acc_2 = {0, 0, false};
+  StepperTick tick = advance_stepper_tick(&acc_1, &acc_2);
+  CHECK(tick.step_1 && !tick.step_2, "shared tick");
+
+  return check_summary("stepper_test");
+}
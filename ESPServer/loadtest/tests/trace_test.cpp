@@ -0,0 +1,75 @@
+/*
+
+Host test of the time sync and latency trace payloads. The NTP-style clock
+estimate is checked on synthetic exchanges with known offsets and delays,
+and every trace must survive an encode/decode round trip.
+
+*/
+
+#include "trace.h"
+#include "protocol.h"
+#include "check.h"
+
+#include <string.h>
+
+/// @brief builds one exchange with a known device clock offset and the
+/// given delays, all in microseconds, and checks the estimate
+void check_exchange(int64_t offset, uint64_t outbound, uint64_t processing, uint64_t inbound) {
+  uint64_t host_send = 1000000000;
+  uint64_t device_receive = host_send + outbound + offset;
+  uint64_t device_send = device_receive + processing;
+  uint64_t host_receive = host_send + outbound + processing + inbound;
+
+  TimeSyncSample sample = time_sync_sample(host_send, device_receive, device_send, host_receive);
+
+  // asymmetric delay shifts the estimate by half the difference
+  int64_t expected_offset = offset + ((int64_t)outbound - (int64_t)inbound) / 2;
+  CHECK(sample.offset == expected_offset, "offset %lld with delays %llu/%llu: got %lld, expected %lld",
+        (long long)offset, (unsigned long long)outbound, (unsigned long long)inbound, (long long)sample.offset,
+        (long long)expected_offset);
+  CHECK(sample.round_trip == (int64_t)(outbound + inbound), "round trip with delays %llu/%llu: got %lld",
+        (unsigned long long)outbound, (unsigned long long)inbound, (long long)sample.round_trip);
+}
+
+void check_time_sync() {
+  check_exchange(0, 250, 50, 250);
+  check_exchange(500000, 250, 50, 250);
+  check_exchange(-500000, 250, 50, 250);
+  check_exchange(123456, 300, 0, 200);
+  check_exchange(-7, 100, 1000, 900);
+
+  uint8_t response[TIME_SYNC_RESPONSE_LENGTH];
+  CHECK(encode_time_sync_response(1, 2, 0x0102030405060708, response) == TIME_SYNC_RESPONSE_LENGTH,
+        "time sync response length");
+  CHECK(get_u64(response) == 1 && get_u64(response + 8) == 2 && get_u64(response + 16) == 0x0102030405060708,
+        "time sync response fields");
+}
+
+void check_command_trace() {
+  CommandTrace traces[] = {
+    {0, 0, 0, 0, 0, 0, 0},
+    {1, 100, 110, 5000, 5010, 6000, 6500},
+    {0xFFFF, 0xFFFFFF00, 0xFFFFFFF0, 0x10, 0x20, 0x30, 0x40}, // micros wrapped mid-command
+  };
+
+  for (const CommandTrace &trace : traces) {
+    uint8_t buffer[COMMAND_TRACE_LENGTH];
+    CHECK(encode_command_trace(&trace, buffer) == COMMAND_TRACE_LENGTH, "trace length");
+
+    CommandTrace decoded;
+    CHECK(decode_command_trace(buffer, sizeof(buffer), &decoded), "trace %u must decode", trace.sequence);
+    CHECK(decoded.sequence == trace.sequence && decoded.socket_receive == trace.socket_receive &&
+              decoded.motion_enqueue == trace.motion_enqueue && decoded.motion_dequeue == trace.motion_dequeue &&
+              decoded.motor_enqueue == trace.motor_enqueue && decoded.stepper_dequeue == trace.stepper_dequeue &&
+              decoded.first_pulse == trace.first_pulse,
+          "trace %u round trip", trace.sequence);
+
+    CHECK(!decode_command_trace(buffer, sizeof(buffer) - 1, &decoded), "short trace must be rejected");
+  }
+}
+
+int main() {
+  check_time_sync();
+  check_command_trace();
+  return check_summary("trace_test");
+}
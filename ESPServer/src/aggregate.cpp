@@ -0,0 +1,136 @@
+/*
+
+Telemetry aggregation. See aggregate.h.
+
+*/
+
+#include "aggregate.h"
+#include "protocol.h"
+#include <math.h>
+
+/// @brief empties a window; the next sample starts it
+void window_reset(TelemetryWindow *window) {
+  window->start_micros = 0;
+  window->end_micros = 0;
+  window->samples = 0;
+  for (uint8_t i = 0; i < AggregateFieldCount; i++) {
+    window->fields[i] = FieldAggregate{0, 0, 0, 0};
+  }
+}
+
+/// @brief adds one sample of every field to a window
+/// @param values the sample, indexed by AggregateField
+/// @param now the time of the sample
+void window_add(TelemetryWindow *window, const float values[AggregateFieldCount], uint32_t now) {
+  if (window->samples == 0) {
+    window->start_micros = now;
+  }
+  window->end_micros = now;
+
+  for (uint8_t i = 0; i < AggregateFieldCount; i++) {
+    FieldAggregate *field = &window->fields[i];
+    float value = values[i];
+
+    if (window->samples == 0 || value < field->min) {
+      field->min = value;
+    }
+    if (window->samples == 0 || value > field->max) {
+      field->max = value;
+    }
+    field->sum += value;
+    field->sum_squares += (double)value * value;
+  }
+  window->samples++;
+}
+
+/// @brief folds a later window into an earlier one, as if every sample of
+/// both had been added to the first
+void window_merge(TelemetryWindow *into, const TelemetryWindow *from) {
+  if (from->samples == 0) {
+    return;
+  }
+  if (into->samples == 0) {
+    *into = *from;
+    return;
+  }
+
+  into->end_micros = from->end_micros;
+  for (uint8_t i = 0; i < AggregateFieldCount; i++) {
+    FieldAggregate *field = &into->fields[i];
+    const FieldAggregate *other = &from->fields[i];
+
+    if (other->min < field->min) {
+      field->min = other->min;
+    }
+    if (other->max > field->max) {
+      field->max = other->max;
+    }
+    field->sum += other->sum;
+    field->sum_squares += other->sum_squares;
+  }
+  into->samples += from->samples;
+}
+
+/// @brief computes the reported statistics of a window; an empty window
+/// summarises to zeros
+void window_summarise(const TelemetryWindow *window, TelemetrySummary *summary) {
+  summary->start_micros = window->start_micros;
+  summary->end_micros = window->end_micros;
+  summary->samples = window->samples;
+
+  for (uint8_t i = 0; i < AggregateFieldCount; i++) {
+    const FieldAggregate *field = &window->fields[i];
+    FieldSummary *out = &summary->fields[i];
+
+    if (window->samples == 0) {
+      *out = FieldSummary{0, 0, 0, 0};
+      continue;
+    }
+    out->min = field->min;
+    out->max = field->max;
+    out->mean = (float)(field->sum / window->samples);
+    out->rms = (float)sqrt(field->sum_squares / window->samples);
+  }
+}
+
+/// @brief writes the window times and sample count as u32s, then min, max,
+/// mean and rms of each field as float32s, in AggregateField order
+/// @param out a buffer of at least TELEMETRY_SUMMARY_LENGTH bytes
+/// @return the number of bytes written
+size_t encode_telemetry_summary(const TelemetrySummary *summary, uint8_t *out) {
+  put_u32(summary->start_micros, out);
+  put_u32(summary->end_micros, out + 4);
+  put_u32(summary->samples, out + 8);
+
+  uint8_t *field_out = out + AGGREGATE_HEADER_LENGTH;
+  for (uint8_t i = 0; i < AggregateFieldCount; i++) {
+    const FieldSummary *field = &summary->fields[i];
+    put_f32(field->min, field_out);
+    put_f32(field->max, field_out + 4);
+    put_f32(field->mean, field_out + 8);
+    put_f32(field->rms, field_out + 12);
+    field_out += AGGREGATE_FIELD_LENGTH;
+  }
+  return TELEMETRY_SUMMARY_LENGTH;
+}
+
+bool decode_telemetry_summary(const uint8_t *data, size_t length, TelemetrySummary *summary) {
+  if (length != TELEMETRY_SUMMARY_LENGTH) {
+    return false;
+  }
+
+  summary->start_micros = get_u32(data);
+  summary->end_micros = get_u32(data + 4);
+  summary->samples = get_u32(data + 8);
+
+  const uint8_t *field_data = data + AGGREGATE_HEADER_LENGTH;
+  for (uint8_t i = 0; i < AggregateFieldCount; i++) {
+    FieldSummary *field = &summary->fields[i];
+    field->min = get_f32(field_data);
+    field->max = get_f32(field_data + 4);
+    field->mean = get_f32(field_data + 8);
+    field->rms = get_f32(field_data + 12);
+    field_data += AGGREGATE_FIELD_LENGTH;
+  }
+  return true;
+}
@@ -0,0 +1,158 @@
+/*
+
+Relay-feedback autotuner. See autotune.h.
+
+*/
+
+#include "autotune.h"
+#include "protocol.h"
+#include <math.h>
+#include <string.h>
+
+/// @brief resets the tuner and begins a relay experiment
+/// @param relay_amplitude the motor output applied either side of zero, rad/s
+/// @param hysteresis the tilt band, in degrees, that must be crossed before
+/// the relay switches; rejects noise
+/// @param max_tilt the tilt, in degrees, at which the experiment is aborted
+/// @param timeout the longest the experiment may run, in seconds
+void autotune_start(Autotuner *tuner, float relay_amplitude, float hysteresis, float max_tilt, float timeout) {
+  memset(tuner, 0, sizeof(Autotuner));
+  tuner->state = AutotuneRunning;
+  tuner->abort_reason = AbortNone;
+  tuner->relay_amplitude = fabsf(relay_amplitude);
+  tuner->hysteresis = hysteresis;
+  tuner->max_tilt = max_tilt;
+  tuner->timeout = timeout;
+}
+
+/// @brief stops a running experiment; the robot returns to PID control
+void autotune_cancel(Autotuner *tuner) {
+  if (tuner->state == AutotuneRunning) {
+    tuner->state = AutotuneAborted;
+    tuner->abort_reason = AbortCancelled;
+  }
+}
+
+/// @brief stops the experiment, recording why
+static void autotune_abort(Autotuner *tuner, AutotuneAbort reason) {
+  tuner->state = AutotuneAborted;
+  tuner->abort_reason = reason;
+}
+
+/// @brief derives the ultimate gain and period from the measured cycles,
+/// then Ziegler-Nichols PID gains (Kp = 0.6 Ku, Ti = Tu / 2, Td = Tu / 8)
+static void autotune_finish(Autotuner *tuner) {
+  float amplitude = tuner->amplitude_sum / AUTOTUNE_MEASURE_CYCLES;
+  float period = tuner->period_sum / AUTOTUNE_MEASURE_CYCLES;
+
+  // describing function of a relay with hysteresis
+  float effective = sqrtf(fmaxf(amplitude * amplitude - tuner->hysteresis * tuner->hysteresis, 1E-6f));
+
+  tuner->ultimate_gain = 4 * tuner->relay_amplitude / ((float)M_PI * effective);
+  tuner->ultimate_period = period;
+  tuner->kp = 0.6f * tuner->ultimate_gain;
+  tuner->ki = 1.2f * tuner->ultimate_gain / period;
+  tuner->kd = 0.075f * tuner->ultimate_gain * period;
+  tuner->mean_sample_time = tuner->sample_time_sum / tuner->sample_count;
+  tuner->state = AutotuneDone;
+}
+
+/// @brief feeds one telemetry sample to a running experiment
+/// @param error the tilt error, in degrees
+/// @param delta_time the time since the previous sample, in seconds
+/// @return the motor output to apply, in rad/s; zero once the experiment
+/// has ended
+float autotune_step(Autotuner *tuner, float error, float delta_time) {
+  if (tuner->state != AutotuneRunning) {
+    return 0;
+  }
+
+  tuner->elapsed += delta_time;
+  tuner->sample_time_sum += delta_time;
+  tuner->sample_count++;
+
+  if (fabsf(error) > tuner->max_tilt) {
+    autotune_abort(tuner, AbortTilt);
+    return 0;
+  }
+  if (tuner->elapsed > tuner->timeout) {
+    autotune_abort(tuner, AbortTimeout);
+    return 0;
+  }
+
+  if (error > tuner->cycle_max) {
+    tuner->cycle_max = error;
+  }
+  if (error < tuner->cycle_min) {
+    tuner->cycle_min = error;
+  }
+
+  // switch the relay once the error leaves the hysteresis band
+  if (!tuner->relay_high && error > tuner->hysteresis) {
+    tuner->relay_high = true;
+
+    // each rising switch closes one full cycle
+    if (tuner->seen_switch) {
+      tuner->last_period = tuner->elapsed - tuner->last_rising_switch;
+      tuner->last_amplitude = (tuner->cycle_max - tuner->cycle_min) / 2;
+      tuner->cycles++;
+
+      if (tuner->cycles > AUTOTUNE_SETTLE_CYCLES) {
+        tuner->period_sum += tuner->last_period;
+        tuner->amplitude_sum += tuner->last_amplitude;
+      }
+    }
+
+    tuner->seen_switch = true;
+    tuner->last_rising_switch = tuner->elapsed;
+    tuner->cycle_max = error;
+    tuner->cycle_min = error;
+
+    if (tuner->cycles >= AUTOTUNE_SETTLE_CYCLES + AUTOTUNE_MEASURE_CYCLES) {
+      autotune_finish(tuner);
+      return 0;
+    }
+  } else if (tuner->relay_high && error < -tuner->hysteresis) {
+    tuner->relay_high = false;
+  }
+
+  return tuner->relay_high ? tuner->relay_amplitude : -tuner->relay_amplitude;
+}
+
+/// @brief writes a status as state, abort reason and cycle count bytes, five
+/// float32 measurements, then the three int16 gains
+/// @param out a buffer of at least AUTOTUNE_STATUS_LENGTH bytes
+/// @return the number of bytes written
+size_t encode_autotune_status(const AutotuneStatus *status, uint8_t *out) {
+  out[0] = status->state;
+  out[1] = status->abort_reason;
+  out[2] = status->cycles;
+  put_f32(status->elapsed, out + 3);
+  put_f32(status->amplitude, out + 7);
+  put_f32(status->period, out + 11);
+  put_f32(status->ultimate_gain, out + 15);
+  put_f32(status->ultimate_period, out + 19);
+  put_u16(status->proportional, out + 23);
+  put_u16(status->integral, out + 25);
+  put_u16(status->derivative, out + 27);
+  return AUTOTUNE_STATUS_LENGTH;
+}
+
+bool decode_autotune_status(const uint8_t *data, size_t length, AutotuneStatus *status) {
+  if (length != AUTOTUNE_STATUS_LENGTH) {
+    return false;
+  }
+
+  status->state = data[0];
+  status->abort_reason = data[1];
+  status->cycles = data[2];
+  status->elapsed = get_f32(data + 3);
+  status->amplitude = get_f32(data + 7);
+  status->period = get_f32(data + 11);
+  status->ultimate_gain = get_f32(data + 15);
+  status->ultimate_period = get_f32(data + 19);
+  status->proportional = (int16_t)get_u16(data + 23);
+  status->integral = (int16_t)get_u16(data + 25);
+  status->derivative = (int16_t)get_u16(data + 27);
+  return true;
+}
@@ -0,0 +1,133 @@
+/*
+
+Biquad design and kernels. Coefficients follow the RBJ audio EQ cookbook.
+
+*/
+
+#include "filter.h"
+#include <math.h>
+
+/// @brief a stage that passes its input through unchanged
+static const BiquadCoefficients PASSTHROUGH = {1, 0, 0, 0, 0};
+
+/// @brief computes the coefficients of a single biquad stage
+/// @param config the stage type, centre/cutoff frequency and Q
+/// @param sample_rate the rate the stage will be run at, in Hz
+/// @return the normalised coefficients; a passthrough if the stage is
+/// disabled or its frequency is not below Nyquist
+BiquadCoefficients design_biquad(BiquadConfig config, float sample_rate) {
+  if (config.type == BiquadNone || config.frequency <= 0 ||
+      config.frequency >= sample_rate / 2 || config.quality <= 0) {
+    return PASSTHROUGH;
+  }
+
+  float omega = 2 * (float)M_PI * config.frequency / sample_rate;
+  float cos_omega = cosf(omega);
+  float alpha = sinf(omega) / (2 * config.quality);
+  float a0 = 1 + alpha;
+
+  BiquadCoefficients c;
+  switch (config.type) {
+    case BiquadLowPass:
+      c.b0 = (1 - cos_omega) / 2;
+      c.b1 = 1 - cos_omega;
+      c.b2 = (1 - cos_omega) / 2;
+      break;
+    case BiquadNotch:
+      c.b0 = 1;
+      c.b1 = -2 * cos_omega;
+      c.b2 = 1;
+      break;
+    default:
+      return PASSTHROUGH;
+  }
+  c.a1 = -2 * cos_omega;
+  c.a2 = 1 - alpha;
+
+  c.b0 /= a0;
+  c.b1 /= a0;
+  c.b2 /= a0;
+  c.a1 /= a0;
+  c.a2 /= a0;
+  return c;
+}
+
+/// @brief runs one sample through a biquad in transposed direct form II
+float run_biquad(const BiquadCoefficients *c, BiquadState *state, float input) {
+  float output = c->b0 * input + state->z1;
+  state->z1 = c->b1 * input - c->a1 * output + state->z2;
+  state->z2 = c->b2 * input - c->a2 * output;
+  return output;
+}
+
+/// @brief sets a biquad's state to its steady state for a constant input,
+/// so the output starts at the DC response to that input instead of at zero
+void prime_biquad(const BiquadCoefficients *c, BiquadState *state, float input) {
+  float output = input * (c->b0 + c->b1 + c->b2) / (1 + c->a1 + c->a2);
+  state->z2 = c->b2 * input - c->a2 * output;
+  state->z1 = c->b1 * input - c->a1 * output + state->z2;
+}
+
+/// @brief clears a bank to an empty cascade
+/// @param sample_rate the rate the bank will be run at, in Hz
+void filter_bank_init(FilterBank *bank, float sample_rate) {
+  bank->sample_rate = sample_rate;
+  bank->stage_count = 0;
+  for (uint8_t i = 0; i < BIQUAD_MAX_STAGES; i++) {
+    bank->config[i] = BiquadConfig{BiquadNone, 0, 0};
+    bank->coefficients[i] = PASSTHROUGH;
+    bank->generation[i] = 0;
+  }
+}
+
+/// @brief replaces one stage of a bank and recomputes its coefficients.
+/// A stage that goes from disabled to enabled has stale or zero channel
+/// state, so each channel primes it from its next input. Retuning an enabled
+/// stage keeps the state; the output then shows a short transient as the
+/// state settles to the new coefficients
+/// @return false if the stage index is out of range
+bool filter_bank_configure(FilterBank *bank, uint8_t stage, BiquadConfig config) {
+  if (stage >= BIQUAD_MAX_STAGES) {
+    return false;
+  }
+
+  if (bank->config[stage].type == BiquadNone && config.type != BiquadNone) {
+    bank->generation[stage]++;
+  }
+
+  bank->config[stage] = config;
+  bank->coefficients[stage] = design_biquad(config, bank->sample_rate);
+
+  // only run up to the last enabled stage
+  bank->stage_count = 0;
+  for (uint8_t i = 0; i < BIQUAD_MAX_STAGES; i++) {
+    if (bank->config[i].type != BiquadNone) {
+      bank->stage_count = i + 1;
+    }
+  }
+  return true;
+}
+
+/// @brief redesigns every stage of a bank for a new sample rate, keeping
+/// channel state
+/// @param sample_rate the rate the bank will be run at, in Hz
+void filter_bank_set_rate(FilterBank *bank, float sample_rate) {
+  bank->sample_rate = sample_rate;
+  for (uint8_t i = 0; i < BIQUAD_MAX_STAGES; i++) {
+    bank->coefficients[i] = design_biquad(bank->config[i], sample_rate);
+  }
+}
+
+/// @brief runs one sample of one channel through every active stage
+/// @param states the channel's state, one entry per stage
+float filter_bank_run(const FilterBank *bank, BiquadState *states, float input) {
+  float output = input;
+  for (uint8_t i = 0; i < bank->stage_count; i++) {
+    if (states[i].generation != bank->generation[i]) {
+      prime_biquad(&bank->coefficients[i], &states[i], output);
+      states[i].generation = bank->generation[i];
+    }
+    output = run_biquad(&bank->coefficients[i], &states[i], output);
+  }
+  return output;
+}
@@ -0,0 +1,167 @@
+/*
+
+Control-link watchdog. See link.h.
+
+*/
+
+#include "link.h"
+#include "protocol.h"
+
+#define ROUND_TRIP_SMOOTHING 0.125 // weight of each new sample, as for TCP's SRTT
+
+void link_init(LinkMonitor *monitor, const LinkThresholds *thresholds) {
+  monitor->thresholds = *thresholds;
+  monitor->armed = false;
+  monitor->state = LinkHealthy;
+  monitor->last_heard = 0;
+  monitor->smoothed_round_trip = 0;
+  monitor->improving = false;
+  monitor->improving_since = 0;
+  monitor->transition_count = 0;
+}
+
+/// @brief moves to a new state and records the transition
+static void link_transition(LinkMonitor *monitor, uint8_t state, uint8_t cause, uint32_t now) {
+  monitor->history[monitor->transition_count % LINK_HISTORY_LENGTH] = LinkTransition{now, monitor->state, state, cause};
+  monitor->transition_count++;
+  monitor->state = state;
+  monitor->improving = false;
+}
+
+/// @brief starts or stops watching the link. Arming counts as hearing from
+/// the client, so the link starts healthy
+void link_arm(LinkMonitor *monitor, bool armed, uint32_t now) {
+  if (armed == monitor->armed) {
+    return;
+  }
+
+  monitor->armed = armed;
+  monitor->last_heard = now;
+  monitor->smoothed_round_trip = 0;
+  link_transition(monitor, LinkHealthy, armed ? LinkCauseArmed : LinkCauseDisarmed, now);
+}
+
+/// @brief records a request from the client and any round trip it measured
+void link_report(LinkMonitor *monitor, const LinkReport *report) {
+  if ((int32_t)(report->received_millis - monitor->last_heard) > 0) {
+    monitor->last_heard = report->received_millis;
+  }
+
+  if (report->round_trip == 0) {
+    return;
+  }
+  if (monitor->smoothed_round_trip == 0) {
+    monitor->smoothed_round_trip = report->round_trip;
+  } else {
+    monitor->smoothed_round_trip += ROUND_TRIP_SMOOTHING * (report->round_trip - monitor->smoothed_round_trip);
+  }
+}
+
+/// @brief re-evaluates the link; call once per control loop
+/// @param now the current time in milliseconds
+/// @return the link state to act on
+uint8_t link_update(LinkMonitor *monitor, uint32_t now) {
+  if (!monitor->armed) {
+    return monitor->state;
+  }
+
+  const LinkThresholds *limits = &monitor->thresholds;
+  int32_t elapsed = now - monitor->last_heard;
+  uint32_t silence = elapsed < 0 ? 0 : elapsed;
+
+  uint8_t target = LinkHealthy;
+  uint8_t cause = LinkCauseSilence;
+  if (silence >= limits->lost_silence) {
+    target = LinkLost;
+  } else if (silence >= limits->hold_silence) {
+    target = LinkHold;
+  } else if (silence >= limits->degraded_silence) {
+    target = LinkDegraded;
+  }
+
+  // a slow link is still a link, so round trips alone never disable the motors
+  uint8_t round_trip_target = LinkHealthy;
+  if (monitor->smoothed_round_trip >= limits->hold_round_trip) {
+    round_trip_target = LinkHold;
+  } else if (monitor->smoothed_round_trip >= limits->degraded_round_trip) {
+    round_trip_target = LinkDegraded;
+  }
+  if (round_trip_target > target) {
+    target = round_trip_target;
+    cause = LinkCauseRoundTrip;
+  }
+
+  if (target > monitor->state) {
+    link_transition(monitor, target, cause, now);
+  } else if (target < monitor->state) {
+    if (!monitor->improving) {
+      monitor->improving = true;
+      monitor->improving_since = now;
+    } else if (now - monitor->improving_since >= limits->recovery_time) {
+      link_transition(monitor, target, LinkCauseRecovered, now);
+    }
+  } else {
+    monitor->improving = false;
+  }
+
+  return monitor->state;
+}
+
+/// @brief applies the staged response for the current state to the drive
+/// controls; call once per control loop, after link_update
+/// @param loop_count the number of control loops run so far
+/// @param telemetry_divisor while the link is not healthy, telemetry is
+/// published every nth loop
+/// @return whether this loop should publish telemetry
+bool link_respond(const LinkMonitor *monitor, uint32_t loop_count, uint32_t telemetry_divisor,
+                  LinkControls *controls) {
+  // hold position: keep balancing, but stop driving
+  if (monitor->state >= LinkHold) {
+    controls->linear_velocity_target = 0;
+    controls->angular_velocity_target = 0;
+  }
+
+  // the client must enable the motors again once the link is back
+  if (monitor->state == LinkLost) {
+    controls->motors_enabled = false;
+  }
+
+  return monitor->state == LinkHealthy || loop_count % telemetry_divisor == 0;
+}
+
+/// @brief whether the client may enable the motors: always while the
+/// watchdog is disarmed, otherwise only once the link is healthy again
+bool link_allows_motors(const LinkMonitor *monitor) {
+  return !monitor->armed || monitor->state == LinkHealthy;
+}
+
+/// @brief writes the link status: state and armed flag as u8s; silence (ms),
+/// smoothed round trip (us) and transition count as u32s; the number of
+/// transitions that follow as a u8; then each retained transition, oldest
+/// first, as timestamp (u32 ms), from, to and cause (u8s)
+/// @param now the current time in milliseconds
+/// @param out a buffer of at least LINK_STATUS_LENGTH bytes
+/// @return the number of bytes written
+size_t encode_link_status(const LinkMonitor *monitor, uint32_t now, uint8_t *out) {
+  int32_t silence = now - monitor->last_heard;
+  uint8_t retained = monitor->transition_count < LINK_HISTORY_LENGTH ? monitor->transition_count : LINK_HISTORY_LENGTH;
+  uint32_t oldest = monitor->transition_count - retained;
+
+  out[0] = monitor->state;
+  out[1] = monitor->armed ? 1 : 0;
+  put_u32(monitor->armed && silence > 0 ? silence : 0, out + 2);
+  put_u32((uint32_t)monitor->smoothed_round_trip, out + 6);
+  put_u32(monitor->transition_count, out + 10);
+  out[14] = retained;
+
+  size_t index = LINK_STATUS_HEADER_LENGTH;
+  for (uint8_t i = 0; i < retained; i++) {
+    const LinkTransition *transition = &monitor->history[(oldest + i) % LINK_HISTORY_LENGTH];
+    put_u32(transition->timestamp, out + index);
+    out[index + 4] = transition->from;
+    out[index + 5] = transition->to;
+    out[index + 6] = transition->cause;
+    index += LINK_TRANSITION_LENGTH;
+  }
+  return index;
+}
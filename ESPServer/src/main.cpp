@@ -11,58 +11,103 @@ Main entry point. Spawns tasks pinned to cores.
 
 void websocket_loop(void *_);
 
+// In STATIC_MEMORY builds every queue and task stack is reserved at compile
+// time, so nothing here touches the heap.
+#ifdef STATIC_MEMORY
+#define DECLARE_QUEUE(name, length, type) \
+  static uint8_t name##_storage[(length) * sizeof(type)]; \
+  static StaticQueue_t name##_control
+#define CREATE_QUEUE(name, length, type) \
+  xQueueCreateStatic(length, sizeof(type), name##_storage, &name##_control)
+#define DECLARE_TASK(name, stack_size) \
+  static StackType_t name##_stack[stack_size]; \
+  static StaticTask_t name##_control
+#define SPAWN_TASK(name, function, label, stack_size, priority, core) \
+  name = xTaskCreateStaticPinnedToCore(function, label, stack_size, NULL, priority, name##_stack, &name##_control, core)
+#else
+#define DECLARE_QUEUE(name, length, type)
+#define CREATE_QUEUE(name, length, type) xQueueCreate(length, sizeof(type))
+#define DECLARE_TASK(name, stack_size)
+#define SPAWN_TASK(name, function, label, stack_size, priority, core) \
+  xTaskCreatePinnedToCore(function, label, stack_size, NULL, priority, &name, core)
+#endif
+
 QueueHandle_t sock_to_motion_queue = NULL;
 QueueHandle_t motor_update_queue = NULL;
 QueueHandle_t motion_to_sock_queue = NULL;
+QueueHandle_t trace_to_sock_queue = NULL;
+QueueHandle_t autotune_to_sock_queue = NULL;
+QueueHandle_t summary_to_sock_queue = NULL;
+QueueHandle_t link_to_motion_queue = NULL;
+QueueHandle_t link_to_sock_queue = NULL;
+
+DECLARE_QUEUE(sock_to_motion, SOCK_TO_MOTION_LENGTH, ConfigQueueItem);
+DECLARE_QUEUE(motor_update, MOTOR_UPDATE_LENGTH, MotorQueueItem);
+DECLARE_QUEUE(motion_to_sock, MOTION_TO_SOCK_LENGTH, MotionInfoQueueItem);
+DECLARE_QUEUE(trace_to_sock, TRACE_TO_SOCK_LENGTH, CommandTrace);
+DECLARE_QUEUE(autotune_to_sock, AUTOTUNE_TO_SOCK_LENGTH, AutotuneStatus);
+DECLARE_QUEUE(summary_to_sock, SUMMARY_TO_SOCK_LENGTH, TelemetryWindow);
+DECLARE_QUEUE(link_to_motion, LINK_TO_MOTION_LENGTH, LinkReport);
+DECLARE_QUEUE(link_to_sock, LINK_TO_SOCK_LENGTH, LinkMonitor);
+
+TaskHandle_t websocket_task = NULL;
+TaskHandle_t telemetry_task = NULL;
+TaskHandle_t stepper_task = NULL;
+
+DECLARE_TASK(websocket_task, WEBSOCKET_STACK_SIZE);
+DECLARE_TASK(telemetry_task, TELEMETRY_STACK_SIZE);
+DECLARE_TASK(stepper_task, STEPPER_STACK_SIZE);
 
 /// @brief sets up arduino serial & mutexes
 void setup() {
   Serial.begin(115200);
 
-  pinMode(AUX_POWER_1, OUTPUT);
-  pinMode(STEP_PIN_1, OUTPUT);
-  pinMode(DIR_PIN_1, OUTPUT);
-  pinMode(STEP_PIN_2, OUTPUT);
-  pinMode(DIR_PIN_2, OUTPUT);
-  digitalWrite(AUX_POWER_1, HIGH);
+  pinMode(ActiveProfile::aux_power_1, OUTPUT);
+  pinMode(ActiveProfile::step_pin_1, OUTPUT);
+  pinMode(ActiveProfile::dir_pin_1, OUTPUT);
+  pinMode(ActiveProfile::step_pin_2, OUTPUT);
+  pinMode(ActiveProfile::dir_pin_2, OUTPUT);
+  digitalWrite(ActiveProfile::aux_power_1, HIGH);
 
   delay(2000);
   debug_print("debug: starting...");
 
-  sock_to_motion_queue = xQueueCreate(10, sizeof(ConfigQueueItem));
-  motor_update_queue = xQueueCreate(10, sizeof(MotorQueueItem));
-  motion_to_sock_queue = xQueueCreate(1, sizeof(MotionInfoQueueItem));
+  sock_to_motion_queue = CREATE_QUEUE(sock_to_motion, SOCK_TO_MOTION_LENGTH, ConfigQueueItem);
+  motor_update_queue = CREATE_QUEUE(motor_update, MOTOR_UPDATE_LENGTH, MotorQueueItem);
+  motion_to_sock_queue = CREATE_QUEUE(motion_to_sock, MOTION_TO_SOCK_LENGTH, MotionInfoQueueItem);
+  trace_to_sock_queue = CREATE_QUEUE(trace_to_sock, TRACE_TO_SOCK_LENGTH, CommandTrace);
+  autotune_to_sock_queue = CREATE_QUEUE(autotune_to_sock, AUTOTUNE_TO_SOCK_LENGTH, AutotuneStatus);
+  summary_to_sock_queue = CREATE_QUEUE(summary_to_sock, SUMMARY_TO_SOCK_LENGTH, TelemetryWindow);
+  link_to_motion_queue = CREATE_QUEUE(link_to_motion, LINK_TO_MOTION_LENGTH, LinkReport);
+  link_to_sock_queue = CREATE_QUEUE(link_to_sock, LINK_TO_SOCK_LENGTH, LinkMonitor);
 
   debug_print("debug: instantiated mutexes");
 
-  xTaskCreatePinnedToCore(
+  SPAWN_TASK(
+    websocket_task,
     websocket_loop,
     "Websocket Loop",
-    4096,
-    NULL,
+    WEBSOCKET_STACK_SIZE,
     10,
-    NULL,
     0);
 
   debug_print("debug: spawned websocket loop on core 0");
 
-  xTaskCreatePinnedToCore(
+  SPAWN_TASK(
+    telemetry_task,
     telemetry_loop,
     "Telemetry Loop",
-    2048,
-    NULL,
+    TELEMETRY_STACK_SIZE,
     5,
-    NULL,
     0);
   debug_print("debug: spawned telemetry loop on core 0");
 
-  xTaskCreatePinnedToCore(
+  SPAWN_TASK(
+    stepper_task,
     stepper_loop,
     "Stepper Loop",
-    4096,
-    NULL,
+    STEPPER_STACK_SIZE,
     50,
-    NULL,
     1);
 
   debug_print("debug: spawned stepper loop on core 1");
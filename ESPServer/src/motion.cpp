@@ -8,6 +8,8 @@ Runs in core zero along with WebsocketServer.
 */
 
 #include "common.h"
+#include "filter.h"
+#include "controller.h"
 #include <Wire.h>
 
 /// @brief stores the previous state of the MPU
@@ -27,7 +29,34 @@ GyroRecord gyro_record;
 KinematicState kinematic_state;
 PidState pid_state;
 uint32_t last_poll = 0;
-double integral, previous = 0; // used in pid loop
+CommandTrace pending_trace = {0}; // latest command waiting to reach the motors
+
+FilterBank gyro_filter;
+FilterBank accel_filter;
+BiquadState accel_x_filter_state[BIQUAD_MAX_STAGES];
+BiquadState accel_y_filter_state[BIQUAD_MAX_STAGES];
+BiquadState accel_z_filter_state[BIQUAD_MAX_STAGES];
+BiquadState omega_y_filter_state[BIQUAD_MAX_STAGES];
+uint8_t selected_filter_bank = GyroFilterBank;
+uint8_t selected_filter_stage = 0;
+double measured_sample_rate = FILTER_SAMPLE_RATE; // Hz; smoothed telemetry loop rate
+
+Autotuner autotuner = {AutotuneIdle};
+
+PidController<ActiveProfile, PidState> pid_controller(&pid_state);
+LqrController<ActiveProfile> lqr_controller;
+Controller *controller = &pid_controller;
+
+double wheel_position = 0;    // rad, integrated from the commanded velocity
+double last_wheel_command = 0; // rad/s, as sent to the stepper loop
+bool controller_changed = true;
+bool motors_were_enabled = false;
+
+TelemetryWindow telemetry_window; // samples not yet taken by the socket task
+
+LinkMonitor link_monitor;
+uint32_t loop_count = 0;
+const char *const link_state_names[] = {"healthy", "degraded", "hold", "lost"};
 
 /// @brief Sets up the gyroscope
 void setup_gyro() {
@@ -37,6 +66,14 @@ void setup_gyro() {
   gyro_record.theta_y = 0;
   gyro_record.timestamp = micros();
 
+  // filters start empty and are configured by the client
+  filter_bank_init(&gyro_filter, FILTER_SAMPLE_RATE);
+  filter_bank_init(&accel_filter, FILTER_SAMPLE_RATE);
+  memset(accel_x_filter_state, 0, sizeof(accel_x_filter_state));
+  memset(accel_y_filter_state, 0, sizeof(accel_y_filter_state));
+  memset(accel_z_filter_state, 0, sizeof(accel_z_filter_state));
+  memset(omega_y_filter_state, 0, sizeof(omega_y_filter_state));
+
   // Start I2C connection with MPU6050
   Wire.setClock(I2C_CLOCK_SPEED);
   Wire.begin();
@@ -97,7 +134,9 @@ Angles angle_from_accel(double accel_x, double accel_y, double accel_z) {
 }
 
 /// @brief Polls the current state of the gyroscope
+/// @tparam Profile the robot profile supplying the fusion weights
 /// @return The x- and y-angles of the gyroscope
+template <typename Profile>
 Angles poll_gyro() {
 
   // Read accelerometer data
@@ -132,6 +171,12 @@ Angles poll_gyro() {
   double omega_y = (double)omega_y_raw / 65.5;
   double omega_z = (double)omega_z_raw / 65.5;
 
+  // remove vibration before the readings reach the estimate and the PID
+  accel_x = filter_bank_run(&accel_filter, accel_x_filter_state, accel_x);
+  accel_y = filter_bank_run(&accel_filter, accel_y_filter_state, accel_y);
+  accel_z = filter_bank_run(&accel_filter, accel_z_filter_state, accel_z);
+  omega_y = filter_bank_run(&gyro_filter, omega_y_filter_state, omega_y);
+
   Angles accel_angle = angle_from_accel(accel_x, accel_y, accel_z);
 
   // Predict angle
@@ -141,7 +186,7 @@ Angles poll_gyro() {
 
   double ddyn_predict_y = gyro_record.theta_y + omega_y * delta_time + 0.5 * angular_accel_y * pow(delta_time, 2);
 
-  double theta_y_predict = ((1 - KYLE_CONSTANT) * accel_angle.theta_y) + KYLE_CONSTANT * ddyn_predict_y;
+  double theta_y_predict = ((1 - Profile::kyle_constant) * accel_angle.theta_y) + Profile::kyle_constant * ddyn_predict_y;
 
   gyro_record.omega_y = omega_y;
   gyro_record.theta_y = theta_y_predict;
@@ -152,34 +197,152 @@ Angles poll_gyro() {
     theta_y_predict};
 }
 
-/// @brief calculates the PID output for the motors
-/// @param error the error in the system
-/// @param delta_time the time elapsed since the last PID calculation
+/// @brief applies a filter parameter update to the selected stage
+/// @param target which parameter of the stage to change
+/// @param value the raw value from the client
+void update_filter(UpdateTarget target, int16_t value) {
+  FilterBank *bank = selected_filter_bank == AccelFilterBank ? &accel_filter : &gyro_filter;
+  BiquadConfig config = bank->config[selected_filter_stage];
+
+  // design at the rate the loop actually runs, not the nominal poll delay
+  filter_bank_set_rate(bank, measured_sample_rate);
+
+  switch (target) {
+    case UpdateTarget::FilterType:
+      config.type = BiquadType(value);
+      break;
+    case UpdateTarget::FilterFrequency:
+      config.frequency = (float)value / 10.0;
+      break;
+    case UpdateTarget::FilterQuality:
+      config.quality = (float)value / 100.0;
+      break;
+    default:
+      return;
+  }
+
+  filter_bank_configure(bank, selected_filter_stage, config);
+
+  if (config.type != BiquadNone && config.frequency >= bank->sample_rate / 2) {
+    debug_println("warning: filter frequency is above nyquist; stage bypassed");
+  }
+}
+
+/// @brief clamps a computed gain into the range of a PidState field
+int16_t clamp_gain(double gain) {
+  if (gain > INT16_MAX) {
+    return INT16_MAX;
+  }
+  if (gain < INT16_MIN) {
+    return INT16_MIN;
+  }
+  return (int16_t)round(gain);
+}
+
+/// @brief converts the autotuner's continuous-time gains into the units
+/// PidController expects
+/// @tparam Profile the robot profile supplying gain scales
+/// @param tuner a tuner that has finished its experiment
+template <typename Profile>
+PidState autotune_gains(const Autotuner *tuner) {
+  double dt = tuner->mean_sample_time;
+
+  PidState gains;
+  gains.proportional = clamp_gain(tuner->kp * Profile::proportional_scale);
+
+  // PidController accumulates error / (100 dt) rather than error * dt
+  gains.integral = clamp_gain(tuner->ki * Profile::integral_scale * 100 * dt * dt);
+
+  // derivative_scale is negative, so a damping Kd gives a negative gain
+  gains.derivative = clamp_gain(tuner->kd * Profile::derivative_scale);
+  return gains;
+}
+
+/// @brief pushes the autotuner's progress to the socket task
+/// @param gains the gains to report; only meaningful once done
+void publish_autotune_status(PidState gains) {
+  AutotuneStatus status;
+  status.state = autotuner.state;
+  status.abort_reason = autotuner.abort_reason;
+  status.cycles = autotuner.cycles;
+  status.elapsed = autotuner.elapsed;
+  status.amplitude = autotuner.last_amplitude;
+  status.period = autotuner.last_period;
+  status.ultimate_gain = autotuner.ultimate_gain;
+  status.ultimate_period = autotuner.ultimate_period;
+  status.proportional = gains.proportional;
+  status.integral = gains.integral;
+  status.derivative = gains.derivative;
+
+  xQueueOverwrite(autotune_to_sock_queue, &status);
+}
+
+/// @brief runs one autotune sample in place of the PID
+/// @param error the tilt error, in degrees
+/// @param delta_time the time since the last sample, in seconds
 /// @returns the angular velocity target for the motors
-MotorTarget run_pid(double error, double delta_time) {
-
-  double proportional = error;
-  integral += error / (delta_time * 100);
-  double derivative = (error - previous) / delta_time;
-  previous = error;
-
-  double output = (((double)pid_state.proportional / PROPORTIONAL_SCALE) * proportional) +
-                  (((double)pid_state.integral / INTEGRAL_SCALE) * integral) +
-                  (((double)pid_state.derivative / DERIVATIVE_SCALE) * derivative);
-
-  if (output >= MAX_ANGULAR_VELOCITY) {
-    previous = 0;
-    output = MAX_ANGULAR_VELOCITY;
-  } else if (output <= -MAX_ANGULAR_VELOCITY) {
-    previous = 0;
-    output = -MAX_ANGULAR_VELOCITY;
+MotorTarget run_autotune(double error, double delta_time) {
+
+  if (!kinematic_state.motors_enabled) {
+    autotune_cancel(&autotuner);
+  }
+
+  double output = autotune_step(&autotuner, error, delta_time);
+  PidState gains = pid_state;
+
+  // the relay amplitude is clamped on start; this keeps the motors within
+  // the profile's limit whatever the tuner returns
+  if (output > ActiveProfile::max_angular_velocity) {
+    output = ActiveProfile::max_angular_velocity;
+  } else if (output < -ActiveProfile::max_angular_velocity) {
+    output = -ActiveProfile::max_angular_velocity;
+  }
+
+  if (autotuner.state == AutotuneDone) {
+    gains = autotune_gains<ActiveProfile>(&autotuner);
+    pid_state = gains;
+
+    // the relay has moved the wheels, so whichever controller is selected
+    // restarts from a clean slate on the next iteration
+    controller_changed = true;
+
+    Serial.print("info: autotune complete. Ku ");
+    Serial.print(autotuner.ultimate_gain);
+    Serial.print(", Tu ");
+    Serial.println(autotuner.ultimate_period);
+  } else if (autotuner.state == AutotuneAborted) {
+    // the controller resumes with its old gains, from a clean slate
+    controller_changed = true;
+
+    Serial.print("warning: autotune aborted with reason ");
+    Serial.println(autotuner.abort_reason);
   }
 
+  publish_autotune_status(gains);
+
   return MotorTarget{
     output,
     output};
 }
 
+/// @brief switches the active controller; it is reset on the next iteration
+/// @param mode the ControllerMode to switch to
+void select_controller(int16_t mode) {
+  switch (mode) {
+    case ControllerMode::ControllerPid:
+      controller = &pid_controller;
+      break;
+    case ControllerMode::ControllerLqr:
+      controller = &lqr_controller;
+      break;
+    default:
+      Serial.print("error: unknown controller mode ");
+      Serial.println(mode);
+      return;
+  }
+  controller_changed = true;
+}
+
 void check_incoming_queue() {
 
   ConfigQueueItem incoming_item;
@@ -190,6 +353,11 @@ void check_incoming_queue() {
     return;
   }
 
+  if (incoming_item.trace.sequence != 0) {
+    pending_trace = incoming_item.trace;
+    pending_trace.motion_dequeue = micros();
+  }
+
   switch (incoming_item.target) {
     case UpdateTarget::PidProportional:
       pid_state.proportional = incoming_item.value;
@@ -207,6 +375,13 @@ void check_incoming_queue() {
       debug_println(incoming_item.value);
       break;
     case UpdateTarget::MotorsEnabled:
+      // enabling them on a link that has not recovered would only be undone
+      // on the next loop
+      if (incoming_item.value == 1 && !link_allows_motors(&link_monitor)) {
+        Serial.print("warning: refusing to enable motors while the control link is ");
+        Serial.println(link_state_names[link_monitor.state]);
+        break;
+      }
       kinematic_state.motors_enabled = incoming_item.value == 1;
       debug_print("debug: updating MotorsEnabled to ");
       debug_println(incoming_item.value == 1);
@@ -226,6 +401,59 @@ void check_incoming_queue() {
       debug_print("debug: updating LinearVelocityTarget to ");
       debug_println(incoming_item.value);
       break;
+    case UpdateTarget::FilterSelect:
+      if (((incoming_item.value >> 8) & 0xFF) > AccelFilterBank) {
+        Serial.println("error: filter bank out of range");
+        return;
+      }
+      if ((incoming_item.value & 0xFF) >= BIQUAD_MAX_STAGES) {
+        Serial.println("error: filter stage out of range");
+        return;
+      }
+      selected_filter_bank = (incoming_item.value >> 8) & 0xFF;
+      selected_filter_stage = incoming_item.value & 0xFF;
+      debug_print("debug: selecting filter stage ");
+      debug_println(incoming_item.value);
+      break;
+    case UpdateTarget::FilterType:
+    case UpdateTarget::FilterFrequency:
+    case UpdateTarget::FilterQuality:
+      update_filter(incoming_item.target, incoming_item.value);
+      debug_print("debug: updating filter parameter to ");
+      debug_println(incoming_item.value);
+      break;
+    case UpdateTarget::Autotune:
+      if (incoming_item.value > 0) {
+        double amplitude = (double)incoming_item.value / 10.0;
+        if (amplitude > ActiveProfile::max_angular_velocity) {
+          Serial.println("warning: autotune relay amplitude clamped to the maximum angular velocity");
+          amplitude = ActiveProfile::max_angular_velocity;
+        }
+        autotune_start(
+          &autotuner,
+          amplitude,
+          AUTOTUNE_HYSTERESIS,
+          AUTOTUNE_MAX_TILT,
+          AUTOTUNE_TIMEOUT);
+        Serial.println("info: starting autotune");
+      } else if (autotuner.state == AutotuneRunning) {
+        autotune_cancel(&autotuner);
+        publish_autotune_status(pid_state);
+
+        // reset the controller before it resumes on the next loop
+        controller_changed = true;
+      }
+      break;
+    case UpdateTarget::ControllerSelect:
+      select_controller(incoming_item.value);
+      debug_print("debug: updating ControllerSelect to ");
+      debug_println(incoming_item.value);
+      break;
+    case UpdateTarget::LinkWatchdog:
+      link_arm(&link_monitor, incoming_item.value == 1, millis());
+      xQueueOverwrite(link_to_sock_queue, &link_monitor);
+      Serial.println(link_monitor.armed ? "info: link watchdog armed" : "info: link watchdog disarmed");
+      break;
     default:
       Serial.print("error: unable to deserialize ConfigQueueItem with target ");
       Serial.print(incoming_item.target);
@@ -234,6 +462,47 @@ void check_incoming_queue() {
   }
 }
 
+/// @brief feeds the socket task's reports to the link watchdog and applies
+/// its staged response. Runs here rather than in the socket task, which can
+/// block on a stalled client
+/// @return whether this loop should publish telemetry
+bool check_link() {
+  LinkReport report;
+
+  if (xQueueReceive(link_to_motion_queue, &report, 0) == pdPASS) {
+    link_report(&link_monitor, &report);
+  }
+
+  uint8_t previous_state = link_monitor.state;
+  uint8_t state = link_update(&link_monitor, millis());
+
+  if (state != previous_state) {
+    Serial.print(state > previous_state ? "warning: control link " : "info: control link ");
+    Serial.print(link_state_names[previous_state]);
+    Serial.print(" -> ");
+    Serial.print(link_state_names[state]);
+    Serial.print(" at ");
+    Serial.println(millis());
+    xQueueOverwrite(link_to_sock_queue, &link_monitor);
+  }
+
+  LinkControls controls = {
+    kinematic_state.linear_velocity_target,
+    kinematic_state.angular_velocity_target,
+    kinematic_state.motors_enabled};
+  bool publish_telemetry = link_respond(&link_monitor, loop_count, LINK_TELEMETRY_DIVISOR, &controls);
+  loop_count++;
+
+  if (kinematic_state.motors_enabled && !controls.motors_enabled) {
+    Serial.println("warning: control link lost; disabling motors");
+  }
+  kinematic_state.linear_velocity_target = controls.linear_velocity_target;
+  kinematic_state.angular_velocity_target = controls.angular_velocity_target;
+  kinematic_state.motors_enabled = controls.motors_enabled;
+
+  return publish_telemetry;
+}
+
 /// @brief interprets sensor inputs and pre-processes for MotorDrive.h
 /// @param _ unused
 u16_t num_push_error = 0;
@@ -245,11 +514,24 @@ void telemetry_loop(void *_) {
   last_poll = micros();
 
   setup_gyro();
+  window_reset(&telemetry_window);
+
+  LinkThresholds link_thresholds = {
+    LINK_DEGRADED_SILENCE,
+    LINK_HOLD_SILENCE,
+    LINK_LOST_SILENCE,
+    LINK_DEGRADED_ROUND_TRIP,
+    LINK_HOLD_ROUND_TRIP,
+    LINK_RECOVERY_TIME};
+  link_init(&link_monitor, &link_thresholds);
 
   for (;;) {
     check_incoming_queue();
 
-    double theta_y = poll_gyro().theta_y + kinematic_state.gyro_offset;
+    // a degraded link gets telemetry less often, shedding queue traffic
+    bool publish_telemetry = check_link();
+
+    double theta_y = poll_gyro<ActiveProfile>().theta_y + kinematic_state.gyro_offset;
 
     double target_theta_y = 0;
 
@@ -259,10 +541,31 @@ void telemetry_loop(void *_) {
     double delta_time = (now - last_poll) / 1E6;
     last_poll = now;
 
-    MotorTarget new_target = run_pid(error, delta_time);
+    if (delta_time > 0) {
+      measured_sample_rate += FILTER_RATE_SMOOTHING * (1 / delta_time - measured_sample_rate);
+    }
 
-    if (abs(integral) > MAXIMUM_INTEGRAL) {
-      integral = MAXIMUM_INTEGRAL * abs(integral) / integral;
+    ControllerInput input;
+    input.tilt = error;
+    input.tilt_rate = gyro_record.omega_y;
+    input.wheel_position = wheel_position;
+    input.wheel_velocity = last_wheel_command;
+    input.velocity_target = (double)kinematic_state.linear_velocity_target / 100.0;
+    input.delta_time = delta_time;
+
+    // start cleanly after a switch or when the motors come back on
+    if (controller_changed || (kinematic_state.motors_enabled && !motors_were_enabled)) {
+      controller->reset(input);
+      controller_changed = false;
+    }
+    motors_were_enabled = kinematic_state.motors_enabled;
+
+    MotorTarget new_target;
+    if (autotuner.state == AutotuneRunning) {
+      new_target = run_autotune(error, delta_time);
+    } else {
+      double output = controller->update(input);
+      new_target = MotorTarget{output, output};
     }
 
     if (!kinematic_state.motors_enabled) {
@@ -270,13 +573,19 @@ void telemetry_loop(void *_) {
       new_target.mot_2_omega = 0;
     }
 
+    last_wheel_command = new_target.mot_1_omega;
+    wheel_position += last_wheel_command * delta_time;
+
     MotorQueueItem motor_update;
     motor_update.motor_target = new_target;
+    motor_update.trace = pending_trace;
+    motor_update.trace.motor_enqueue = micros();
 
     if (xQueueSend(motor_update_queue, &motor_update, 0) != pdPASS) {
       num_push_error ++;
     } else {
       num_push_error = 0;
+      pending_trace.sequence = 0;
     }
 
     if (num_push_error > 10) {
@@ -285,11 +594,32 @@ void telemetry_loop(void *_) {
 
     MotionInfo motion_info;
     motion_info.gyro_value = theta_y;
-    motion_info.integral_sum = integral;
+    motion_info.integral_sum = pid_controller.integral;
     motion_info.motor_target = new_target.mot_1_omega;
+    motion_info.motors_enabled = kinematic_state.motors_enabled;
+
+    // the socket task only wants the latest, and the motors' state in it
+    // must not lag behind an unread older item
+    if (publish_telemetry) {
+      xQueueOverwrite(motion_to_sock_queue, &motion_info);
+    }
+
+    float samples[AggregateFieldCount];
+    samples[AggregateTilt] = theta_y;
+    samples[AggregateTiltRate] = gyro_record.omega_y;
+    samples[AggregateMotorTarget] = new_target.mot_1_omega;
+    samples[AggregateIntegralSum] = pid_controller.integral;
+    window_add(&telemetry_window, samples, micros());
+
+    // if the socket task has not taken the last window, keep growing this
+    // one so no sample is dropped
+    if (publish_telemetry && telemetry_window.samples >= AGGREGATE_WINDOW_SAMPLES &&
+        xQueueSend(summary_to_sock_queue, &telemetry_window, 0) == pdPASS) {
+      window_reset(&telemetry_window);
+    }
 
-    if (xQueueSend(motion_to_sock_queue, &motion_info, 0) != pdPASS) {
-      // debug_println("warning: failed to push update to motion -> sock");
+    if (publish_telemetry && link_monitor.armed) {
+      xQueueOverwrite(link_to_sock_queue, &link_monitor);
     }
 
     delay(GYRO_POLL_DELAY);
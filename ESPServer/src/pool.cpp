@@ -0,0 +1,85 @@
+/*
+
+Fixed-size buffer pool. See pool.h.
+
+*/
+
+#include "pool.h"
+#include "protocol.h"
+
+/// @brief prepares a pool over storage of block_size * block_count bytes
+void pool_init(BufferPool *pool, uint8_t *storage, size_t block_size, uint8_t block_count) {
+  pool->storage = storage;
+  pool->block_size = block_size;
+  pool->block_count = block_count > POOL_MAX_BLOCKS ? POOL_MAX_BLOCKS : block_count;
+  pool->used_mask = 0;
+  pool->in_use = 0;
+  pool->peak = 0;
+  pool->failures = 0;
+}
+
+/// @brief takes a free block from the pool
+/// @param length the number of bytes needed
+/// @return the block, or NULL if length is zero, larger than a block, or
+/// every block is in use
+uint8_t *pool_alloc(BufferPool *pool, size_t length) {
+  if (length == 0) {
+    return NULL;
+  }
+  if (length > pool->block_size) {
+    pool->failures++;
+    return NULL;
+  }
+
+  for (uint8_t i = 0; i < pool->block_count; i++) {
+    if (!(pool->used_mask & (1u << i))) {
+      pool->used_mask |= 1u << i;
+      pool->in_use++;
+      if (pool->in_use > pool->peak) {
+        pool->peak = pool->in_use;
+      }
+      return pool->storage + i * pool->block_size;
+    }
+  }
+
+  pool->failures++;
+  return NULL;
+}
+
+/// @brief returns a block to the pool; NULL is ignored
+void pool_free(BufferPool *pool, uint8_t *block) {
+  if (block == NULL) {
+    return;
+  }
+
+  size_t index = (block - pool->storage) / pool->block_size;
+  if (index >= pool->block_count || !(pool->used_mask & (1u << index))) {
+    return;
+  }
+
+  pool->used_mask &= ~(1u << index);
+  pool->in_use--;
+}
+
+/// @brief writes memory stats as consecutive u32 values in struct order
+/// @param out a buffer of at least MEMORY_STATS_LENGTH bytes
+/// @return the number of bytes written
+size_t encode_memory_stats(const MemoryStats *stats, uint8_t *out) {
+  uint32_t values[] = {
+    stats->websocket_stack_free,
+    stats->telemetry_stack_free,
+    stats->stepper_stack_free,
+    stats->heap_free,
+    stats->heap_minimum_free,
+    stats->heap_largest_block,
+    stats->pool_blocks,
+    stats->pool_in_use,
+    stats->pool_peak,
+    stats->pool_failures,
+  };
+
+  for (uint8_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    put_u32(values[i], out + 4 * i);
+  }
+  return MEMORY_STATS_LENGTH;
+}
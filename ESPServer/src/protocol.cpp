@@ -0,0 +1,389 @@
+/*
+
+Wire protocol codec; see protocol.h for the frame layouts. Nothing in here
+touches the network, so it is shared by the firmware and host tooling.
+
+*/
+
+#include "protocol.h"
+#include <string.h>
+
+/// @brief big-endian integer helpers used by every payload encoding
+void put_u16(uint16_t value, uint8_t *out) {
+  out[0] = (value >> 8) & 0xFF;
+  out[1] = value & 0xFF;
+}
+
+void put_u32(uint32_t value, uint8_t *out) {
+  put_u16(value >> 16, out);
+  put_u16(value, out + 2);
+}
+
+void put_u64(uint64_t value, uint8_t *out) {
+  put_u32(value >> 32, out);
+  put_u32(value, out + 4);
+}
+
+uint16_t get_u16(const uint8_t *data) {
+  return (uint16_t)data[0] << 8 | data[1];
+}
+
+uint32_t get_u32(const uint8_t *data) {
+  return (uint32_t)get_u16(data) << 16 | get_u16(data + 2);
+}
+
+uint64_t get_u64(const uint8_t *data) {
+  return (uint64_t)get_u32(data) << 32 | get_u32(data + 4);
+}
+
+/// @brief writes an IEEE 754 float32, big endian
+void put_f32(float value, uint8_t *out) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  put_u32(bits, out);
+}
+
+float get_f32(const uint8_t *data) {
+  uint32_t bits = get_u32(data);
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/// @brief continues a CRC-16/CCITT-FALSE calculation
+/// @param crc the running crc; start with 0xFFFF
+/// @param data the bytes to add
+/// @param length the number of bytes to add
+/// @return the updated crc
+uint16_t crc16_update(uint16_t crc, const uint8_t *data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      if (crc & 0x8000) {
+        crc = (crc << 1) ^ 0x1021;
+      } else {
+        crc <<= 1;
+      }
+    }
+  }
+  return crc;
+}
+
+/// @brief computes the CRC-16/CCITT-FALSE of a buffer
+uint16_t crc16(const uint8_t *data, size_t length) {
+  return crc16_update(0xFFFF, data, length);
+}
+
+/// @brief writes an unsigned LEB128 varint
+/// @param value the value to encode
+/// @param out a buffer of at least VARINT_MAX_LENGTH bytes
+/// @return the number of bytes written
+size_t varint_encode(uint32_t value, uint8_t *out) {
+  size_t i = 0;
+  do {
+    uint8_t byte = value & 0x7F;
+    value >>= 7;
+    if (value) {
+      byte |= 0x80;
+    }
+    out[i++] = byte;
+  } while (value);
+  return i;
+}
+
+void varint_reset(VarintDecoder *decoder) {
+  decoder->value = 0;
+  decoder->shift = 0;
+}
+
+/// @brief feeds a single byte into a varint decoder
+/// @return VarintDone once the final byte has been read
+VarintStatus varint_feed(VarintDecoder *decoder, uint8_t byte) {
+  if (decoder->shift >= 7 * VARINT_MAX_LENGTH) {
+    return VarintOverflow;
+  }
+  // the last byte only has room for the top four bits of a u32
+  if (decoder->shift == 28 && (byte & 0x70) != 0) {
+    return VarintOverflow;
+  }
+
+  decoder->value |= (uint32_t)(byte & 0x7F) << decoder->shift;
+  decoder->shift += 7;
+
+  if (byte & 0x80) {
+    return VarintIncomplete;
+  }
+  return VarintDone;
+}
+
+/// @brief decodes a varint from a buffer
+/// @param value set to the decoded value
+/// @return the number of bytes consumed, or zero if the varint is truncated
+/// or malformed
+size_t varint_decode(const uint8_t *data, size_t length, uint32_t *value) {
+  VarintDecoder decoder;
+  varint_reset(&decoder);
+
+  for (size_t i = 0; i < length; i++) {
+    switch (varint_feed(&decoder, data[i])) {
+      case VarintDone:
+        *value = decoder.value;
+        return i + 1;
+      case VarintOverflow:
+        return 0;
+      case VarintIncomplete:
+        break;
+    }
+  }
+  return 0;
+}
+
+/// @brief writes a v1 header
+/// @param out a buffer of at least V1_HEADER_LENGTH bytes
+/// @return the number of bytes written
+size_t encode_v1_header(uint8_t operation, uint16_t payload_length, uint8_t *out) {
+  out[0] = HEADER_BYTE;
+  out[1] = HEADER_BYTE;
+  out[2] = operation;
+  put_u16(payload_length, out + 3);
+  return V1_HEADER_LENGTH;
+}
+
+/// @brief writes a v2 header, up to and including the length varint
+/// @param out a buffer of at least V2_MAX_HEADER_LENGTH bytes
+/// @return the number of bytes written
+size_t encode_v2_header(uint8_t operation, uint32_t payload_length, uint8_t *out) {
+  out[0] = HEADER_BYTE;
+  out[1] = HEADER_BYTE;
+  out[2] = PROTOCOL_V2;
+  out[3] = operation;
+  return V2_FIXED_HEADER_LENGTH + varint_encode(payload_length, out + V2_FIXED_HEADER_LENGTH);
+}
+
+/// @brief computes the crc that trails a v2 frame
+/// @param header the encoded header, including the two header bytes
+uint16_t v2_frame_crc(const uint8_t *header, size_t header_length, const uint8_t *payload, size_t payload_length) {
+  uint16_t crc = crc16(header + 2, header_length - 2);
+  return crc16_update(crc, payload, payload_length);
+}
+
+/// @brief encodes a complete v2 frame into a buffer
+/// @return the length of the frame, or zero if it does not fit
+size_t encode_v2_frame(uint8_t operation, const uint8_t *payload, size_t payload_length, uint8_t *out, size_t capacity) {
+  uint8_t header[V2_MAX_HEADER_LENGTH];
+  size_t header_length = encode_v2_header(operation, payload_length, header);
+
+  size_t frame_length = header_length + payload_length + V2_CRC_LENGTH;
+  if (frame_length > capacity) {
+    return 0;
+  }
+
+  uint16_t crc = v2_frame_crc(header, header_length, payload, payload_length);
+
+  memcpy(out, header, header_length);
+  if (payload_length > 0) {
+    memcpy(out + header_length, payload, payload_length);
+  }
+  put_u16(crc, out + frame_length - 2);
+  return frame_length;
+}
+
+/// @brief validates and decodes a complete v2 frame held in a buffer
+/// @param payload set to point at the payload inside data
+/// @return the length of the frame, or zero if the frame is incomplete,
+/// malformed or fails its crc
+size_t decode_v2_frame(const uint8_t *data, size_t length, uint8_t *operation, const uint8_t **payload, uint32_t *payload_length) {
+  if (length < V2_FIXED_HEADER_LENGTH) {
+    return 0;
+  }
+  if (data[0] != HEADER_BYTE || data[1] != HEADER_BYTE || data[2] != PROTOCOL_V2) {
+    return 0;
+  }
+
+  uint32_t body_length = 0;
+  size_t varint_length = varint_decode(data + V2_FIXED_HEADER_LENGTH, length - V2_FIXED_HEADER_LENGTH, &body_length);
+  if (varint_length == 0) {
+    return 0;
+  }
+
+  size_t header_length = V2_FIXED_HEADER_LENGTH + varint_length;
+  if (body_length > length - header_length || length - header_length - body_length < V2_CRC_LENGTH) {
+    return 0;
+  }
+
+  const uint8_t *body = data + header_length;
+  uint16_t expected = v2_frame_crc(data, header_length, body, body_length);
+  uint16_t received = get_u16(body + body_length);
+  if (expected != received) {
+    return 0;
+  }
+
+  *operation = data[3];
+  *payload = body;
+  *payload_length = body_length;
+  return header_length + body_length + V2_CRC_LENGTH;
+}
+
+/// @brief the type tag used to encode a status field
+static FieldType status_field_type(uint8_t field) {
+  switch (field) {
+    case FieldPidProportional:
+    case FieldPidIntegral:
+    case FieldPidDerivative:
+      return TypeInt16;
+    case FieldMotorsEnabled:
+      return TypeBool;
+    default:
+      return TypeFloat32;
+  }
+}
+
+static size_t field_type_length(FieldType type) {
+  switch (type) {
+    case TypeInt16:
+      return 2;
+    case TypeBool:
+      return 1;
+    case TypeFloat32:
+      return 4;
+  }
+  return 0;
+}
+
+/// @brief the encoded length of a v2 status response for a field mask
+size_t status_v2_length(uint32_t mask) {
+  uint8_t scratch[VARINT_MAX_LENGTH];
+  mask &= STATUS_MASK_ALL;
+
+  size_t length = varint_encode(mask, scratch);
+  for (uint8_t field = 0; field < StatusFieldCount; field++) {
+    if (mask & (1u << field)) {
+      length += 1 + field_type_length(status_field_type(field));
+    }
+  }
+  return length;
+}
+
+/// @brief encodes the fields selected by mask as a v2 status response:
+/// the mask as a varint, then a type tag and big-endian value per field in
+/// ascending field order
+/// @return the number of bytes written, or zero if it does not fit
+size_t encode_status_v2(const StatusSnapshot *status, uint32_t mask, uint8_t *out, size_t capacity) {
+  mask &= STATUS_MASK_ALL;
+  if (status_v2_length(mask) > capacity) {
+    return 0;
+  }
+
+  size_t index = varint_encode(mask, out);
+
+  for (uint8_t field = 0; field < StatusFieldCount; field++) {
+    if (!(mask & (1u << field))) {
+      continue;
+    }
+
+    FieldType type = status_field_type(field);
+    out[index++] = type;
+
+    int16_t int_value = 0;
+    float float_value = 0;
+    switch (field) {
+      case FieldPidProportional:
+        int_value = status->pid_proportional;
+        break;
+      case FieldPidIntegral:
+        int_value = status->pid_integral;
+        break;
+      case FieldPidDerivative:
+        int_value = status->pid_derivative;
+        break;
+      case FieldGyroOffset:
+        float_value = status->gyro_offset;
+        break;
+      case FieldGyroValue:
+        float_value = status->gyro_value;
+        break;
+      case FieldIntegralSum:
+        float_value = status->integral_sum;
+        break;
+      case FieldMotorTarget:
+        float_value = status->motor_target;
+        break;
+    }
+
+    switch (type) {
+      case TypeInt16:
+        put_u16(int_value, out + index);
+        break;
+      case TypeBool:
+        out[index] = status->motors_enabled ? 1 : 0;
+        break;
+      case TypeFloat32:
+        put_f32(float_value, out + index);
+        break;
+    }
+    index += field_type_length(type);
+  }
+
+  return index;
+}
+
+/// @brief decodes a v2 status response; fields absent from the mask are
+/// left untouched
+/// @param mask set to the mask of fields present in the response
+/// @return false if the response is malformed
+bool decode_status_v2(const uint8_t *data, size_t length, StatusSnapshot *status, uint32_t *mask) {
+  size_t index = varint_decode(data, length, mask);
+  if (index == 0 || (*mask & ~STATUS_MASK_ALL)) {
+    return false;
+  }
+
+  for (uint8_t field = 0; field < StatusFieldCount; field++) {
+    if (!(*mask & (1u << field))) {
+      continue;
+    }
+
+    FieldType type = status_field_type(field);
+    if (index + 1 + field_type_length(type) > length || data[index] != type) {
+      return false;
+    }
+    const uint8_t *value = data + index + 1;
+    index += 1 + field_type_length(type);
+
+    int16_t int_value = 0;
+    float float_value = 0;
+    if (type == TypeInt16) {
+      int_value = (int16_t)get_u16(value);
+    } else if (type == TypeFloat32) {
+      float_value = get_f32(value);
+    }
+
+    switch (field) {
+      case FieldPidProportional:
+        status->pid_proportional = int_value;
+        break;
+      case FieldPidIntegral:
+        status->pid_integral = int_value;
+        break;
+      case FieldPidDerivative:
+        status->pid_derivative = int_value;
+        break;
+      case FieldMotorsEnabled:
+        status->motors_enabled = value[0] != 0;
+        break;
+      case FieldGyroOffset:
+        status->gyro_offset = float_value;
+        break;
+      case FieldGyroValue:
+        status->gyro_value = float_value;
+        break;
+      case FieldIntegralSum:
+        status->integral_sum = float_value;
+        break;
+      case FieldMotorTarget:
+        status->motor_target = float_value;
+        break;
+    }
+  }
+
+  return index == length;
+}
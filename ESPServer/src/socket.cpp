@@ -6,7 +6,36 @@ tasks.
 */
 
 #include <WiFi.h>
+#include <esp_timer.h>
 #include "common.h"
+#include "pool.h"
+
+// request payloads come from a fixed pool in STATIC_MEMORY builds. Only the
+// websocket task allocates payloads, so the pool needs no locking
+#ifdef STATIC_MEMORY
+static uint8_t payload_pool_storage[PAYLOAD_POOL_BLOCKS * MAX_PAYLOAD_LENGTH];
+#endif
+BufferPool payload_pool = {0};
+
+/// @brief allocates a buffer for a request payload
+/// @param length the payload length
+/// @return the buffer; NULL if the length is zero or allocation failed
+uint8_t *alloc_payload(uint16_t length) {
+#ifdef STATIC_MEMORY
+  return pool_alloc(&payload_pool, length);
+#else
+  return (uint8_t *)malloc(length);
+#endif
+}
+
+/// @brief releases a buffer from alloc_payload; NULL is ignored
+void free_payload(uint8_t *payload) {
+#ifdef STATIC_MEMORY
+  pool_free(&payload_pool, payload);
+#else
+  free(payload);
+#endif
+}
 
 /// @brief handles websocket connections and messages
 class WebsocketServer {
@@ -34,6 +63,7 @@ class WebsocketServer {
       WiFiClient client = server->accept();
       if (client) {
         Serial.println("\ninfo: accepting new client");
+        protocol_version = PROTOCOL_V1; // every connection starts on v1
         return client;
       } else {
         Serial.print(".");
@@ -47,6 +77,10 @@ class WebsocketServer {
   /// @return the OperationRequest constructed from the connection
   OperationRequest resolve_incoming(WiFiClient *client) {
 
+    if (protocol_version == PROTOCOL_V2) {
+      return resolve_incoming_v2(client);
+    }
+
     uint16_t read = 0;
     uint8_t operation = 0;
 
@@ -59,6 +93,8 @@ class WebsocketServer {
 
     debug_println("debug: resolving incoming request");
 
+    uint32_t waiting_since = millis();
+
     while (1) {
 
       if (!client->connected()) {
@@ -66,7 +102,12 @@ class WebsocketServer {
         return OperationRequest{false, 0, NULL, 0, NULL};
       }
 
+      if (!client->available() && client_stalled(client, waiting_since)) {
+        return OperationRequest{false, 0, NULL, 0, NULL};
+      }
+
       if (client->available()) {
+        uint64_t received_micros = esp_timer_get_time();
         uint8_t header[5];
         client->readBytes(header, sizeof(header));
 
@@ -80,19 +121,25 @@ class WebsocketServer {
         operation = header[2];
         payload_length = header[3] << 8 | header[4];
 
-        payload = (uint8_t *)malloc(payload_length);
+        payload = alloc_payload(payload_length);
+        if (payload == NULL && payload_length > 0) {
+          Serial.print("error: unable to allocate payload of length ");
+          Serial.println(payload_length);
+          discard_bytes(client, payload_length);
+          return OperationRequest{false, 0, NULL, 0, NULL};
+        }
         client->readBytes(payload, payload_length);
 
 #ifdef DEBUG
         debug_print("debug: received the following payload: ");
-        for (uint8_t i = 0; i < payload_length; i++) {
+        for (uint16_t i = 0; i < payload_length; i++) {
           debug_print("  ");
           debug_print(*(payload + i));
         }
         debug_println();
 #endif
 
-        return OperationRequest{true, operation, payload, payload_length, client};
+        return OperationRequest{true, operation, payload, payload_length, client, received_micros};
       } else {
         delay(1);
       }
@@ -103,18 +150,227 @@ class WebsocketServer {
     return OperationRequest{false, 0, NULL, 0, NULL};
   }
 
-  /// @brief echos bytes from the client
+  /// @brief converts an incoming v2 frame into an OperationRequest
+  /// @param client is a pointer to the WiFiClient who is streaming the message
+  /// @return the OperationRequest constructed from the connection; invalid if
+  /// the frame is malformed or fails its crc
+  OperationRequest resolve_incoming_v2(WiFiClient *client) {
+
+    debug_println("debug: resolving incoming v2 request");
+
+    uint32_t waiting_since = millis();
+
+    while (1) {
+
+      if (!client->connected()) {
+        Serial.println("error: client lost connection");
+        return OperationRequest{false, 0, NULL, 0, NULL};
+      }
+
+      if (!client->available() && client_stalled(client, waiting_since)) {
+        return OperationRequest{false, 0, NULL, 0, NULL};
+      }
+
+      if (!client->available()) {
+        delay(1);
+        continue;
+      }
+
+      uint64_t received_micros = esp_timer_get_time();
+
+      uint8_t header[V2_MAX_HEADER_LENGTH];
+      if (!sync_v2_header(client, header)) {
+        Serial.println("error: timed out reading v2 header");
+        return OperationRequest{false, 0, NULL, 0, NULL};
+      }
+
+      // read the length varint one byte at a time
+      size_t header_length = V2_FIXED_HEADER_LENGTH;
+      VarintDecoder decoder;
+      varint_reset(&decoder);
+      VarintStatus status = VarintIncomplete;
+      while (status == VarintIncomplete) {
+        if (client->readBytes(header + header_length, 1) != 1) {
+          Serial.println("error: timed out reading v2 length");
+          return OperationRequest{false, 0, NULL, 0, NULL};
+        }
+        status = varint_feed(&decoder, header[header_length]);
+        header_length++;
+      }
+
+      if (status == VarintOverflow || decoder.value > MAX_PAYLOAD_LENGTH) {
+        Serial.println("error: invalid v2 payload length");
+        return OperationRequest{false, 0, NULL, 0, NULL};
+      }
+
+      uint16_t payload_length = decoder.value;
+      uint8_t *payload = alloc_payload(payload_length);
+      uint8_t crc_bytes[V2_CRC_LENGTH];
+
+      if (payload == NULL && payload_length > 0) {
+        Serial.print("error: unable to allocate payload of length ");
+        Serial.println(payload_length);
+        discard_bytes(client, payload_length + V2_CRC_LENGTH);
+        return OperationRequest{false, 0, NULL, 0, NULL};
+      }
+
+      if (client->readBytes(payload, payload_length) != payload_length ||
+          client->readBytes(crc_bytes, V2_CRC_LENGTH) != V2_CRC_LENGTH) {
+        Serial.println("error: timed out reading v2 payload");
+        free_payload(payload);
+        return OperationRequest{false, 0, NULL, 0, NULL};
+      }
+
+      uint16_t expected = v2_frame_crc(header, header_length, payload, payload_length);
+      uint16_t received = crc_bytes[0] << 8 | crc_bytes[1];
+      if (expected != received) {
+        Serial.print("error: v2 crc mismatch on operation ");
+        Serial.println(header[3]);
+        free_payload(payload);
+        return OperationRequest{false, 0, NULL, 0, NULL};
+      }
+
+      return OperationRequest{true, header[3], payload, payload_length, client, received_micros};
+    }
+  }
+
+  /// @brief reads up to the start of the next v2 frame, one byte at a time,
+  /// so a corrupted header only costs the bytes before the next valid one
+  /// @param client the client to read from
+  /// @param header set to the fixed header of the frame, V2_FIXED_HEADER_LENGTH
+  /// bytes
+  /// @return false if the client timed out before a frame start was found
+  bool sync_v2_header(WiFiClient *client, uint8_t *header) {
+    size_t matched = 0;
+    uint32_t skipped = 0;
+
+    while (matched < V2_FIXED_HEADER_LENGTH) {
+      uint8_t byte;
+      if (client->readBytes(&byte, 1) != 1) {
+        return false;
+      }
+
+      if (matched == 3 || byte == (matched < 2 ? HEADER_BYTE : PROTOCOL_V2)) {
+        header[matched++] = byte;
+      } else if (matched == 2 && byte == HEADER_BYTE) {
+        // the last two bytes can still start a frame
+        skipped++;
+      } else {
+        skipped += matched + (byte == HEADER_BYTE ? 0 : 1);
+        matched = 0;
+        if (byte == HEADER_BYTE) {
+          header[matched++] = byte;
+        }
+      }
+    }
+
+    if (skipped > 0) {
+      Serial.print("error: skipped ");
+      Serial.print(skipped);
+      Serial.println(" byte(s) before a valid v2 header");
+    }
+    return true;
+  }
+
+  /// @brief drops a client that has gone quiet while the link watchdog is
+  /// armed, so a new connection can take over. The motion task has already
+  /// staged its response by the time this fires
+  /// @param client the client being waited on
+  /// @param waiting_since when the wait for the next request began, in ms
+  /// @return true if the client was dropped
+  bool client_stalled(WiFiClient *client, uint32_t waiting_since) {
+    if (!link_armed || millis() - waiting_since < REQUEST_TIMEOUT_MILLIS) {
+      return false;
+    }
+    Serial.println("error: client stalled; dropping connection");
+    client->stop();
+    return true;
+  }
+
+  /// @brief reads and drops bytes of a request that cannot be handled, so
+  /// the stream stays aligned to frame boundaries
+  /// @param client the client to read from
+  /// @param length the number of bytes to drop
+  void discard_bytes(WiFiClient *client, size_t length) {
+    uint8_t scratch[32];
+    while (length > 0) {
+      size_t chunk = length < sizeof(scratch) ? length : sizeof(scratch);
+      if (client->readBytes(scratch, chunk) != chunk) {
+        return;
+      }
+      length -= chunk;
+    }
+  }
+
+  /// @brief writes a response frame using the negotiated protocol version
+  /// @param client the client to respond to
+  /// @param operation_code the operation being responded to
+  /// @param payload the response body; may be NULL if payload_length is zero
+  /// @param payload_length the length of the response body
+  void write_frame(WiFiClient *client, uint8_t operation_code, const uint8_t *payload, uint16_t payload_length) {
+    if (protocol_version == PROTOCOL_V2) {
+      uint8_t header[V2_MAX_HEADER_LENGTH];
+      size_t header_length = encode_v2_header(operation_code, payload_length, header);
+      uint16_t crc = v2_frame_crc(header, header_length, payload, payload_length);
+      uint8_t crc_bytes[] = {(uint8_t)(crc >> 8), (uint8_t)crc};
+
+      client->write(header, header_length);
+      if (payload_length > 0) {
+        client->write(payload, payload_length);
+      }
+      client->write(crc_bytes, sizeof(crc_bytes));
+    } else {
+      uint8_t header[V1_HEADER_LENGTH];
+      encode_v1_header(operation_code, payload_length, header);
+
+      client->write(header, sizeof(header));
+      if (payload_length > 0) {
+        client->write(payload, payload_length);
+      }
+    }
+  }
+
+  /// @brief echos bytes from the client. v1 echoes the raw payload; v2
+  /// responds with a framed copy
   /// @param operation the operation to respond to
   void echo(OperationRequest *operation) {
 
-    if (operation->payload == NULL) {
+    if (operation->payload == NULL && operation->payload_length > 0) {
       Serial.println("error: cannot echo NULL payload; memory error");
+    } else if (protocol_version == PROTOCOL_V2) {
+      write_frame(operation->client, OpEcho, operation->payload, operation->payload_length);
     } else {
       operation->client->write(operation->payload, operation->payload_length);
     }
     Serial.println("info: echoed payload");
   }
 
+  /// @brief agrees on a protocol version with the client. The request holds
+  /// the highest version the client supports; the response, framed in the
+  /// current version, holds the version used from then on
+  /// @param operation the operation to respond to
+  void negotiate(OperationRequest *operation) {
+
+    uint8_t requested = PROTOCOL_V1;
+    if (operation->payload_length > 0) {
+      requested = *(operation->payload);
+    }
+
+    uint8_t accepted = requested;
+    if (accepted > PROTOCOL_MAX_VERSION) {
+      accepted = PROTOCOL_MAX_VERSION;
+    }
+    if (accepted < PROTOCOL_V1) {
+      accepted = PROTOCOL_V1;
+    }
+
+    write_frame(operation->client, OpNegotiate, &accepted, 1);
+    protocol_version = accepted;
+
+    Serial.print("info: negotiated protocol version ");
+    Serial.println(accepted);
+  }
+
   void check_incoming_queue() {
 
     MotionInfoQueueItem incoming_item;
@@ -122,15 +378,62 @@ class WebsocketServer {
     if (xQueueReceive(motion_to_sock_queue, &incoming_item, 0) == pdPASS) {
       debug_println("debug: received item from motion -> sock");
       motion_info_cache = incoming_item.motion_info;
+      // the motion task may have refused or undone an update
+      kinematic_state_cache.motors_enabled = motion_info_cache.motors_enabled;
       debug_println("debug: updated motion info cache");
     }
 
+    AutotuneStatus incoming_autotune;
+
+    if (xQueueReceive(autotune_to_sock_queue, &incoming_autotune, 0) == pdPASS) {
+      autotune_cache = incoming_autotune;
+
+      // the motion task has already committed these gains
+      if (incoming_autotune.state == AutotuneDone) {
+        pid_state_cache.proportional = incoming_autotune.proportional;
+        pid_state_cache.integral = incoming_autotune.integral;
+        pid_state_cache.derivative = incoming_autotune.derivative;
+        debug_println("debug: updated pid cache from autotune");
+      }
+    }
+
+    CommandTrace incoming_trace;
+
+    if (xQueueReceive(trace_to_sock_queue, &incoming_trace, 0) == pdPASS) {
+      trace_cache = incoming_trace;
+      debug_println("debug: updated latency trace cache");
+    }
+
+    TelemetryWindow incoming_window;
+
+    if (xQueueReceive(summary_to_sock_queue, &incoming_window, 0) == pdPASS) {
+      window_merge(&summary_cache, &incoming_window);
+    }
+
+    LinkMonitor incoming_link;
+
+    if (xQueueReceive(link_to_sock_queue, &incoming_link, 0) == pdPASS) {
+      link_cache = incoming_link;
+
+      // mirror the motion task's staged response; the motors' state comes
+      // back with the motion info
+      if (link_cache.state >= LinkHold) {
+        kinematic_state_cache.linear_velocity_target = 0;
+        kinematic_state_cache.angular_velocity_target = 0;
+      }
+    }
+
   }
 
   void status_poll(OperationRequest *operation) {
 
     check_incoming_queue();
 
+    if (protocol_version == PROTOCOL_V2) {
+      status_poll_v2(operation);
+      return;
+    }
+
     uint8_t i = 0;
     int16_t variables[] = {
       pid_state_cache.proportional,
@@ -143,9 +446,9 @@ class WebsocketServer {
       (int16_t)(motion_info_cache.motor_target * 100.0),
     };
 
-    uint8_t max_packet_size = 4 * sizeof(variables) / 2;
+    const uint8_t max_packet_size = 4 * sizeof(variables) / 2;
 
-    uint8_t *payload = (uint8_t *)malloc(max_packet_size);
+    uint8_t payload[max_packet_size];
 
     uint8_t payload_index = 0;
     for (uint8_t i = 0; i < sizeof(variables) / 2; i++) {
@@ -166,21 +469,200 @@ class WebsocketServer {
     operation->client->write(payload, payload_index);
     debug_print("debug: responded to poll request. content length ");
     debug_println(payload_index);
+  }
+
+  /// @brief responds with the typed fields selected by the request's field
+  /// mask. An empty payload selects every field; a malformed mask selects
+  /// none, so the client still gets a response
+  /// @param operation the operation to respond to
+  void status_poll_v2(OperationRequest *operation) {
+
+    uint32_t mask = STATUS_MASK_ALL;
+    if (operation->payload_length > 0 &&
+        varint_decode(operation->payload, operation->payload_length, &mask) == 0) {
+      Serial.println("error: malformed status field mask; responding with no fields");
+      mask = 0;
+    }
+
+    StatusSnapshot snapshot;
+    snapshot.pid_proportional = pid_state_cache.proportional;
+    snapshot.pid_integral = pid_state_cache.integral;
+    snapshot.pid_derivative = pid_state_cache.derivative;
+    snapshot.motors_enabled = kinematic_state_cache.motors_enabled;
+    snapshot.gyro_offset = kinematic_state_cache.gyro_offset;
+    snapshot.gyro_value = motion_info_cache.gyro_value;
+    snapshot.integral_sum = motion_info_cache.integral_sum;
+    snapshot.motor_target = motion_info_cache.motor_target;
+
+    uint8_t payload[VARINT_MAX_LENGTH + StatusFieldCount * 5];
+    size_t payload_length = encode_status_v2(&snapshot, mask, payload, sizeof(payload));
+
+    write_frame(operation->client, OpStatusPoll, payload, payload_length);
+    debug_print("debug: responded to v2 poll request. content length ");
+    debug_println(payload_length);
+  }
+
+
+  /// @brief responds to an NTP-style time sync request. The request holds the
+  /// host send time; the response echoes it with the device receive and send
+  /// times so the client can estimate the clock offset and round trip
+  /// @param operation the operation to respond to
+  void time_sync(OperationRequest *operation) {
+
+    if (operation->payload_length != TIME_SYNC_REQUEST_LENGTH) {
+      Serial.println("error: time sync payload must be 8 bytes");
+      return;
+    }
+
+    uint8_t payload[TIME_SYNC_RESPONSE_LENGTH];
+    encode_time_sync_response(
+      get_u64(operation->payload),
+      operation->received_micros,
+      esp_timer_get_time(),
+      payload);
+
+    write_frame(operation->client, OpTimeSync, payload, sizeof(payload));
+  }
+
+  /// @brief responds with the stage timestamps of the most recent variable
+  /// update to reach the motors
+  /// @param operation the operation to respond to
+  void latency_trace(OperationRequest *operation) {
+
+    check_incoming_queue();
+
+    uint8_t payload[COMMAND_TRACE_LENGTH];
+    encode_command_trace(&trace_cache, payload);
+
+    write_frame(operation->client, OpLatencyTrace, payload, sizeof(payload));
+    debug_print("debug: responded with latency trace ");
+    debug_println(trace_cache.sequence);
+  }
+
 
-    free(payload);
+  /// @brief responds with task stack high-water marks, heap figures and
+  /// payload pool usage
+  /// @param operation the operation to respond to
+  void memory_stats(OperationRequest *operation) {
+
+    MemoryStats stats;
+    stats.websocket_stack_free = uxTaskGetStackHighWaterMark(websocket_task);
+    stats.telemetry_stack_free = uxTaskGetStackHighWaterMark(telemetry_task);
+    stats.stepper_stack_free = uxTaskGetStackHighWaterMark(stepper_task);
+    stats.heap_free = ESP.getFreeHeap();
+    stats.heap_minimum_free = ESP.getMinFreeHeap();
+    stats.heap_largest_block = ESP.getMaxAllocHeap();
+    stats.pool_blocks = payload_pool.block_count;
+    stats.pool_in_use = payload_pool.in_use;
+    stats.pool_peak = payload_pool.peak;
+    stats.pool_failures = payload_pool.failures;
+
+    uint8_t payload[MEMORY_STATS_LENGTH];
+    encode_memory_stats(&stats, payload);
+
+    write_frame(operation->client, OpMemoryStats, payload, sizeof(payload));
+    debug_println("debug: responded with memory stats");
+  }
+
+
+  /// @brief responds with the progress or result of the last autotune
+  /// @param operation the operation to respond to
+  void autotune_status(OperationRequest *operation) {
+
+    check_incoming_queue();
+
+    uint8_t payload[AUTOTUNE_STATUS_LENGTH];
+    encode_autotune_status(&autotune_cache, payload);
+
+    write_frame(operation->client, OpAutotuneStatus, payload, sizeof(payload));
+  }
+
+
+  /// @brief responds with min, max, mean and rms of each telemetry field over
+  /// every sample since the previous summary, then starts a new one
+  /// @param operation the operation to respond to
+  void telemetry_summary(OperationRequest *operation) {
+
+    check_incoming_queue();
+
+    TelemetrySummary summary;
+    window_summarise(&summary_cache, &summary);
+
+    uint8_t payload[TELEMETRY_SUMMARY_LENGTH];
+    encode_telemetry_summary(&summary, payload);
+
+    write_frame(operation->client, OpTelemetrySummary, payload, sizeof(payload));
+    window_reset(&summary_cache);
+    debug_print("debug: responded with telemetry summary of ");
+    debug_println(summary.samples);
+  }
+
+
+  /// @brief tells the link watchdog that the client was heard from
+  /// @param round_trip the client's latest round trip in us; zero if the
+  /// request carried none
+  void report_link(uint32_t round_trip) {
+    LinkReport report = {(uint32_t)millis(), round_trip};
+
+    // the queue only holds the latest report, so keep a round trip the
+    // motion task has not taken yet rather than overwriting it with none
+    LinkReport pending;
+    if (report.round_trip == 0 && xQueueReceive(link_to_motion_queue, &pending, 0) == pdPASS) {
+      report.round_trip = pending.round_trip;
+    }
+    xQueueOverwrite(link_to_motion_queue, &report);
+  }
+
+
+  /// @brief answers a heartbeat. The request holds a sequence number (u16)
+  /// and the round trip of the previous heartbeat in us (u32, zero if
+  /// unknown); the response echoes the sequence and adds the link state
+  /// @param operation the operation to respond to
+  void heartbeat(OperationRequest *operation) {
+
+    if (operation->payload_length != HEARTBEAT_REQUEST_LENGTH) {
+      Serial.println("error: heartbeat payload must be 6 bytes");
+      return;
+    }
+
+    report_link(get_u32(operation->payload + 2));
+    check_incoming_queue();
+
+    uint8_t payload[HEARTBEAT_RESPONSE_LENGTH];
+    payload[0] = operation->payload[0];
+    payload[1] = operation->payload[1];
+    payload[2] = link_cache.state;
+
+    write_frame(operation->client, OpHeartbeat, payload, sizeof(payload));
+  }
+
+
+  /// @brief responds with the link watchdog's state and its recent
+  /// timestamped transitions
+  /// @param operation the operation to respond to
+  void link_status(OperationRequest *operation) {
+
+    check_incoming_queue();
+
+    uint8_t payload[LINK_STATUS_LENGTH];
+    size_t payload_length = encode_link_status(&link_cache, millis(), payload);
+
+    write_frame(operation->client, OpLinkStatus, payload, payload_length);
   }
 
 
 /// handles variable updates
 /// @param operation is a pointer to the operation to handle
   void handle_var_update(OperationRequest *operation) {
-    if (operation->operation_code != 1) {
+    if (operation->operation_code != OpVariableUpdate) {
       Serial.print("error: variable update must have operation code 1, found ");
       Serial.println(operation->operation_code);
       return;
     }
     if (operation->payload == NULL) {
       Serial.println("error: operation payload pointer null; memory error");
+    } else if (operation->payload_length < 3) {
+      Serial.println("error: variable update payload too short");
     } else {
 
       uint8_t target = *(operation->payload);
@@ -194,6 +676,15 @@ class WebsocketServer {
       update.target = UpdateTarget(target);
       update.value = value;
 
+      // trace sequence zero is reserved for untraced commands
+      if (++trace_sequence == 0) {
+        trace_sequence = 1;
+      }
+      update.trace = CommandTrace{0};
+      update.trace.sequence = trace_sequence;
+      update.trace.socket_receive = (uint32_t)operation->received_micros;
+      update.trace.motion_enqueue = micros();
+
       if (xQueueSend(sock_to_motion_queue, &update, 0) != pdPASS) {
         Serial.println("warning: failed to send item update");
       } else {
@@ -243,6 +734,19 @@ class WebsocketServer {
           debug_print("debug: updating LinearVelocityTarget cache to ");
           debug_println(update.value);
           break;
+        case UpdateTarget::FilterSelect:
+        case UpdateTarget::FilterType:
+        case UpdateTarget::FilterFrequency:
+        case UpdateTarget::FilterQuality:
+        case UpdateTarget::Autotune:
+        case UpdateTarget::ControllerSelect:
+          // not reported in the status; nothing to cache
+          break;
+        case UpdateTarget::LinkWatchdog:
+          link_armed = update.value == 1;
+          debug_print("debug: updating LinkWatchdog cache to ");
+          debug_println(link_armed);
+          break;
         default:
           Serial.print("error: unable to deserialize ConfigQueueItem with target ");
           Serial.print(update.target);
@@ -255,10 +759,17 @@ class WebsocketServer {
 
  private:
   WiFiServer *server;
+  uint8_t protocol_version = PROTOCOL_V1;
 
   MotionInfo motion_info_cache;
   KinematicState kinematic_state_cache;
   PidState pid_state_cache;
+  CommandTrace trace_cache = {0};
+  AutotuneStatus autotune_cache = {AutotuneIdle};
+  TelemetryWindow summary_cache = {0};
+  LinkMonitor link_cache = {{0}};
+  bool link_armed = false;
+  uint16_t trace_sequence = 0;
 };
 
 void handle_message(OperationRequest *operation);
@@ -267,12 +778,12 @@ void websocket_loop(void *_);
 /// @brief relays general message from websocket to serial
 /// @param operation is a pointer to the operation to handle
 void handle_message(OperationRequest *operation) {
-  if (operation->operation_code != 0) {
+  if (operation->operation_code != OpMessage) {
     Serial.print("error: message must have operation code 0, found ");
     Serial.println(operation->operation_code);
     return;
   }
-  if (operation->payload == NULL) {
+  if (operation->payload == NULL && operation->payload_length > 0) {
     Serial.println("error: operation payload pointer null; memory error");
   } else {
     Serial.print("\ninfo: received incoming message: ");
@@ -289,6 +800,11 @@ void handle_message(OperationRequest *operation) {
 void websocket_loop(void *_) {
 
   debug_println("debug: opened websocket handler");
+
+#ifdef STATIC_MEMORY
+  pool_init(&payload_pool, payload_pool_storage, MAX_PAYLOAD_LENGTH, PAYLOAD_POOL_BLOCKS);
+#endif
+
   delay(1000);
   Serial.println("info: starting server...");
   WiFiServer server(SERVER_PORT);
@@ -313,29 +829,66 @@ void websocket_loop(void *_) {
       continue;
     }
 
+    // heartbeats report their own round trip
+    if (request.operation_code != OpHeartbeat) {
+      sock.report_link(0);
+    }
+
     // dispatch request
     switch (request.operation_code) {
-      case 0:
+      case OpMessage:
         debug_println("debug: dispatching to message");
         handle_message(&request);
         break;
-      case 1:
+      case OpVariableUpdate:
         debug_println("debug: dispatching to variable update");
         sock.handle_var_update(&request);
         break;
-      case 2:
+      case OpEcho:
         debug_println("debug: dispatching to echo");
         sock.echo(&request);
         break;
-      case 3:
+      case OpStatusPoll:
         debug_println("debug: dispatching to status poll");
         sock.status_poll(&request);
         break;
+      case OpNegotiate:
+        debug_println("debug: dispatching to negotiate");
+        sock.negotiate(&request);
+        break;
+      case OpTimeSync:
+        debug_println("debug: dispatching to time sync");
+        sock.time_sync(&request);
+        break;
+      case OpLatencyTrace:
+        debug_println("debug: dispatching to latency trace");
+        sock.latency_trace(&request);
+        break;
+      case OpMemoryStats:
+        debug_println("debug: dispatching to memory stats");
+        sock.memory_stats(&request);
+        break;
+      case OpAutotuneStatus:
+        debug_println("debug: dispatching to autotune status");
+        sock.autotune_status(&request);
+        break;
+      case OpTelemetrySummary:
+        debug_println("debug: dispatching to telemetry summary");
+        sock.telemetry_summary(&request);
+        break;
+      case OpHeartbeat:
+        debug_println("debug: dispatching to heartbeat");
+        sock.heartbeat(&request);
+        break;
+      case OpLinkStatus:
+        debug_println("debug: dispatching to link status");
+        sock.link_status(&request);
+        break;
       default:
         Serial.print("error: unknown operation ");
         Serial.println(request.operation_code);
     }
 
-    free(request.payload);
+    free_payload(request.payload);
   }
 }
\ No newline at end of file
@@ -6,36 +6,63 @@ in motion.cpp.
 The stepper_loop is extremely time-sensitive, so any time-intensive functions
 should be executed in core 0, then referenced here via mutex.
 
+Steps are generated with a phase accumulator (DDS): every STEP_TICK_MICROS
+each motor adds its increment to a 32-bit phase, and a step is emitted when
+the phase wraps. The step rate therefore has a resolution of 1/2^32 steps per
+tick instead of being rounded to a whole-microsecond delay.
+
 */
 
 #include "common.h"
-
-uint32_t last_loop_micros = 0;
-
-uint32_t last_step_s1 = 0;
-uint32_t last_step_s2 = 0;
-int32_t current_wait_1 = 500;
-int32_t current_wait_2 = 500;
-
-/// @brief converts motor angular velocity into the corresponding pulse delay. Called in core 1 only
-/// @param angular_velocity is the targetted angular velocity
-/// @return the delay, in microseconds, to pulse to meet the target angular velocity
-int32_t angular_vel_to_step_delay(double angular_velocity) {
-  if (abs(angular_velocity) < 1) {
-    return UINT16_MAX;
-  }
-
-  return (int32_t)((2 * 3.141592 * 1E6) / (STEPS_PER_REV * angular_velocity));
+#include "stepper.h"
+
+// every step must fit in its own tick at each profile's top speed, whichever
+// profile this build selects
+static_assert(max_step_rate<FranklinProfile>() * STEP_TICK_MICROS < 1E6,
+              "STEP_TICK_MICROS is too long for FranklinProfile's maximum step rate");
+static_assert(max_step_rate<FranklinEighthStepProfile>() * STEP_TICK_MICROS < 1E6,
+              "STEP_TICK_MICROS is too long for FranklinEighthStepProfile's maximum step rate");
+
+PhaseAccumulator accumulator_1 = {0, 0, false};
+PhaseAccumulator accumulator_2 = {0, 0, false};
+
+uint32_t next_tick_micros = 0;
+
+CommandTrace active_trace = {0};
+bool trace_awaiting_pulse = false;
+
+/// @brief stamps the active trace with its first pulse and hands it back to
+/// the socket task
+/// @param first_pulse the time of the first pulse at the new rate
+void complete_trace(uint32_t first_pulse) {
+  active_trace.first_pulse = first_pulse;
+  xQueueOverwrite(trace_to_sock_queue, &active_trace);
+  trace_awaiting_pulse = false;
 }
 
 void update_motor_targets() {
   MotorQueueItem new_target;
 
   if (xQueueReceive(motor_update_queue, &new_target, 0) == pdPASS) {
-    current_wait_1 = angular_vel_to_step_delay(new_target.motor_target.mot_1_omega);
-    current_wait_2 = angular_vel_to_step_delay(new_target.motor_target.mot_2_omega);
-  }
+    set_accumulator_target<ActiveProfile>(&accumulator_1, new_target.motor_target.mot_1_omega);
+    set_accumulator_target<ActiveProfile>(&accumulator_2, new_target.motor_target.mot_2_omega);
+
+    // direction is latched here, well ahead of the next pulse
+    digitalWrite(ActiveProfile::dir_pin_1, accumulator_1.reverse ? HIGH : LOW);
+    digitalWrite(ActiveProfile::dir_pin_2, accumulator_2.reverse ? HIGH : LOW);
+
+    if (new_target.trace.sequence != 0) {
+      active_trace = new_target.trace;
+      active_trace.stepper_dequeue = micros();
 
+      // a stopped motor takes effect as soon as the target is applied
+      if (accumulator_1.increment == 0 && accumulator_2.increment == 0) {
+        complete_trace(active_trace.stepper_dequeue);
+      } else {
+        trace_awaiting_pulse = true;
+      }
+    }
+  }
 }
 
 /// @brief a real-time loop that sends steps to the motor. Runs on core 1
@@ -43,38 +70,37 @@ void update_motor_targets() {
 void stepper_loop(void *_) {
   debug_println("debug: starting stepper loop...");
   delay(5000);
+  next_tick_micros = micros();
   while (1) {
-    // measure loop time
-    long int now = micros();
-    int delta = now - last_loop_micros;
-    last_loop_micros = now;
-
-    if ((now - last_step_s1) > abs(current_wait_1) && current_wait_1 != UINT16_MAX) {
-      if (current_wait_1 < 0) {
-        digitalWrite(DIR_PIN_1, HIGH);
-      } else {
-        digitalWrite(DIR_PIN_1, LOW);
-      }
+    // wait for the next tick
+    while ((int32_t)(micros() - next_tick_micros) < 0) {
+    }
+    next_tick_micros += STEP_TICK_MICROS;
 
-      digitalWrite(STEP_PIN_1, HIGH);
-      delayMicroseconds(10);
-      digitalWrite(STEP_PIN_1, LOW);
-      last_step_s1 = now;
+    // if we fell more than a tick behind, resynchronise rather than bursting
+    if ((int32_t)(micros() - next_tick_micros) > STEP_TICK_MICROS) {
+      next_tick_micros = micros() + STEP_TICK_MICROS;
     }
-    if ((now - last_step_s2) > abs(current_wait_2) && current_wait_2 != UINT16_MAX) {
 
-      if (current_wait_2 < 0) {
-        digitalWrite(DIR_PIN_2, HIGH);
-      } else {
-        digitalWrite(DIR_PIN_2, LOW);
+    StepperTick tick = advance_stepper_tick(&accumulator_1, &accumulator_2);
+
+    // both motors are pulsed together so their steps stay in sync
+    if (tick.step_1 || tick.step_2) {
+      if (tick.step_1) {
+        digitalWrite(ActiveProfile::step_pin_1, HIGH);
+      }
+      if (tick.step_2) {
+        digitalWrite(ActiveProfile::step_pin_2, HIGH);
       }
+      delayMicroseconds(STEP_PULSE_MICROS);
+      digitalWrite(ActiveProfile::step_pin_1, LOW);
+      digitalWrite(ActiveProfile::step_pin_2, LOW);
 
-      digitalWrite(STEP_PIN_2, HIGH);
-      delayMicroseconds(10);
-      digitalWrite(STEP_PIN_2, LOW);
-      last_step_s2 = now;
+      if (trace_awaiting_pulse) {
+        complete_trace(micros());
+      }
     }
 
     update_motor_targets();
   }
-}
\ No newline at end of file
+}
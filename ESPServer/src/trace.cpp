@@ -0,0 +1,62 @@
+/*
+
+Encoding for time sync and latency trace payloads. See trace.h.
+
+*/
+
+#include "trace.h"
+#include "protocol.h"
+
+/// @brief writes the response to a time sync request: the host's send time
+/// echoed back, then the device's receive and send times, all u64 big endian
+/// @param out a buffer of at least TIME_SYNC_RESPONSE_LENGTH bytes
+/// @return the number of bytes written
+size_t encode_time_sync_response(uint64_t host_send, uint64_t device_receive, uint64_t device_send, uint8_t *out) {
+  put_u64(host_send, out);
+  put_u64(device_receive, out + 8);
+  put_u64(device_send, out + 16);
+  return TIME_SYNC_RESPONSE_LENGTH;
+}
+
+/// @brief estimates the clock offset from one exchange, as in NTP
+/// @param host_send t0, host clock
+/// @param device_receive t1, device clock
+/// @param device_send t2, device clock
+/// @param host_receive t3, host clock
+TimeSyncSample time_sync_sample(uint64_t host_send, uint64_t device_receive, uint64_t device_send, uint64_t host_receive) {
+  int64_t outbound = (int64_t)(device_receive - host_send);
+  int64_t inbound = (int64_t)(device_send - host_receive);
+
+  return TimeSyncSample{
+    (outbound + inbound) / 2,
+    (int64_t)(host_receive - host_send) - (int64_t)(device_send - device_receive)};
+}
+
+/// @brief writes a trace as its sequence followed by each stage timestamp
+/// @param out a buffer of at least COMMAND_TRACE_LENGTH bytes
+/// @return the number of bytes written
+size_t encode_command_trace(const CommandTrace *trace, uint8_t *out) {
+  put_u16(trace->sequence, out);
+  put_u32(trace->socket_receive, out + 2);
+  put_u32(trace->motion_enqueue, out + 6);
+  put_u32(trace->motion_dequeue, out + 10);
+  put_u32(trace->motor_enqueue, out + 14);
+  put_u32(trace->stepper_dequeue, out + 18);
+  put_u32(trace->first_pulse, out + 22);
+  return COMMAND_TRACE_LENGTH;
+}
+
+bool decode_command_trace(const uint8_t *data, size_t length, CommandTrace *trace) {
+  if (length != COMMAND_TRACE_LENGTH) {
+    return false;
+  }
+
+  trace->sequence = get_u16(data);
+  trace->socket_receive = get_u32(data + 2);
+  trace->motion_enqueue = get_u32(data + 6);
+  trace->motion_dequeue = get_u32(data + 10);
+  trace->motor_enqueue = get_u32(data + 14);
+  trace->stepper_dequeue = get_u32(data + 18);
+  trace->first_pulse = get_u32(data + 22);
+  return true;
+}
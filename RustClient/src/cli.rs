@@ -7,12 +7,14 @@ January 2024
 use super::{FranklinClient, PythonClient, VariableUpdateTarget};
 use std::{
     io::{self, Write},
-    thread::sleep,
+    sync::{Arc, Mutex},
+    thread::{self, sleep},
     time::{Duration, Instant},
 };
 use term_size::dimensions;
 
 const GYRO_GRAPH_LIM: u8 = 45;
+const LINK_KEEPALIVE_CHECK: Duration = Duration::from_millis(50);
 
 /// Handles PID update command
 ///
@@ -89,6 +91,39 @@ fn handle_mot(command: Vec<&str>, esp_container: &mut Option<FranklinClient>) {
     }
 }
 
+/// Handles controller selection command
+///
+/// # Arguments
+/// * `command` - A Vec of arguments
+/// * `esp_container` - A mutable reference to FranklinClient wrapped in Option<>
+///
+/// # Example
+/// `>>> ctrl lqr` Will switch balancing to the LQR controller
+fn handle_ctrl(command: Vec<&str>, esp_container: &mut Option<FranklinClient>) {
+    match esp_container {
+        Some(esp) => {
+            if command.len() != 2 {
+                println!("error: missing arguments");
+                return;
+            }
+
+            let value = match command[1] {
+                "pid" => 0,
+                "lqr" => 1,
+                _ => {
+                    println!("error: invalid argument. expected pid/lqr");
+                    return;
+                }
+            };
+
+            esp.send_update(VariableUpdateTarget::ControllerSelect, value);
+        }
+        None => {
+            println!("error: not connected to esp")
+        }
+    }
+}
+
 /// Handles gyro update command
 ///
 /// # Arguments
@@ -123,6 +158,193 @@ fn handle_gyro(command: Vec<&str>, esp_container: &mut Option<FranklinClient>) {
     }
 }
 
+/// Handles drive command. The velocity is fed forward by the LQR controller;
+/// the PID ignores it
+///
+/// # Arguments
+/// * `command` - A Vec of arguments
+/// * `esp_container` - A mutable reference to FranklinClient wrapped in Option<>
+///
+/// # Example
+/// `>>> drive 2.5` Drives forward with a wheel velocity of 2.5 rad/s
+/// `>>> drive 0` Stops driving and balances in place
+fn handle_drive(command: Vec<&str>, esp_container: &mut Option<FranklinClient>) {
+    match esp_container {
+        Some(esp) => {
+            if command.len() != 2 {
+                println!("error: missing arguments");
+                return;
+            }
+
+            let velocity = match command[1].to_string().parse::<f32>() {
+                Ok(val) => val,
+                Err(_err) => {
+                    println!("error: illegal value {}", command[1]);
+                    return;
+                }
+            };
+
+            // the device takes hundredths of rad/s
+            let value = (velocity * 100.) as i16;
+
+            esp.send_update(VariableUpdateTarget::LinearVelocity, value)
+        }
+        None => {
+            println!("error: not connected to esp")
+        }
+    }
+}
+
+/// Handles IMU filter update command
+///
+/// # Arguments
+/// * `command` - A Vec of arguments
+/// * `esp_container` - A mutable reference to FranklinClient wrapped in Option<>
+///
+/// # Example
+/// `>>> filter gyro 0 lp 8 0.707` Sets gyro stage 0 to an 8 Hz low-pass
+/// `>>> filter accel 1 notch 12 2` Sets accel stage 1 to a 12 Hz notch
+/// `>>> filter gyro 0 off` Disables gyro stage 0
+fn handle_filter(command: Vec<&str>, esp_container: &mut Option<FranklinClient>) {
+    match esp_container {
+        Some(esp) => {
+            if command.len() != 4 && command.len() != 6 {
+                println!("error: missing arguments");
+                return;
+            }
+
+            let bank: i16 = match command[1] {
+                "gyro" => 0,
+                "accel" => 1,
+                _ => {
+                    println!("error: invalid filter bank '{}'", command[1]);
+                    return;
+                }
+            };
+
+            let stage = match command[2].to_string().parse::<u8>() {
+                Ok(val) => val as i16,
+                Err(_err) => {
+                    println!("error: illegal stage {}", command[2]);
+                    return;
+                }
+            };
+
+            let filter_type: i16 = match command[3] {
+                "off" => 0,
+                "lp" => 1,
+                "notch" => 2,
+                _ => {
+                    println!("error: invalid filter type '{}'", command[3]);
+                    return;
+                }
+            };
+
+            esp.send_update(VariableUpdateTarget::FilterSelect, bank << 8 | stage);
+
+            if filter_type != 0 {
+                if command.len() != 6 {
+                    println!("error: missing frequency and q");
+                    return;
+                }
+
+                let (frequency, quality) = match (
+                    command[4].to_string().parse::<f32>(),
+                    command[5].to_string().parse::<f32>(),
+                ) {
+                    (Ok(f), Ok(q)) => (f, q),
+                    _ => {
+                        println!("error: illegal frequency or q");
+                        return;
+                    }
+                };
+
+                esp.send_update(VariableUpdateTarget::FilterFrequency, (frequency * 10.) as i16);
+                esp.send_update(VariableUpdateTarget::FilterQuality, (quality * 100.) as i16);
+            }
+
+            esp.send_update(VariableUpdateTarget::FilterType, filter_type);
+        }
+        None => {
+            println!("error: not connected to esp")
+        }
+    }
+}
+
+/// Handles PID autotune command. Starts a relay experiment and streams its
+/// progress until it finishes
+///
+/// # Arguments
+/// * `command` - A Vec of arguments
+/// * `esp_container` - A mutable reference to FranklinClient wrapped in Option<>
+///
+/// # Example
+/// `>>> autotune 8` Runs a relay experiment at ±8 rad/s
+/// `>>> autotune cancel` Stops a running experiment
+fn handle_autotune(command: Vec<&str>, esp_container: &mut Option<FranklinClient>) {
+    match esp_container {
+        Some(esp) => {
+            if command.len() != 2 {
+                println!("error: missing arguments");
+                return;
+            }
+
+            if command[1] == "cancel" {
+                esp.send_update(VariableUpdateTarget::Autotune, 0);
+                return;
+            }
+
+            let amplitude = match command[1].to_string().parse::<f32>() {
+                Ok(val) if val > 0. => val,
+                _ => {
+                    println!("error: illegal amplitude {}", command[1]);
+                    return;
+                }
+            };
+
+            esp.send_update(VariableUpdateTarget::Autotune, (amplitude * 10.) as i16);
+            sleep(Duration::from_millis(100));
+
+            loop {
+                let (state, map) = esp.poll_autotune();
+
+                match state {
+                    1 => println!(
+                        "info: autotune running. cycle {}, amplitude {:.2}°, period {:.3}s",
+                        map["Cycles"], map["Amplitude"], map["Period"]
+                    ),
+                    2 => {
+                        println!("Autotune result: {{");
+                        let mut sorted_pairs: Vec<_> = map.iter().collect();
+                        sorted_pairs.sort_by(|a, b| a.0.cmp(b.0));
+                        for (key, value) in sorted_pairs {
+                            println!("\t{}: {}", key, value);
+                        }
+                        println!("}}");
+                        return;
+                    }
+                    3 => {
+                        let reason = match map["Abort Reason"] as u8 {
+                            1 => "tilt limit exceeded",
+                            2 => "timed out",
+                            3 => "cancelled",
+                            _ => "unknown",
+                        };
+                        println!("warning: autotune aborted: {reason}");
+                        return;
+                    }
+                    _ => println!("info: waiting for autotune to start"),
+                }
+
+                sleep(Duration::from_millis(250));
+            }
+        }
+        None => {
+            println!("error: not connected to esp")
+        }
+    }
+}
+
 /// Handles rudimentary graph output
 ///
 /// # Arguments
@@ -155,8 +377,9 @@ fn handle_graph(command: Vec<&str>, esp_container: &mut Option<FranklinClient>)
             };
 
             while (Instant::now() - start).as_secs() < duration {
+                esp.keep_link_alive();
                 let map = esp.poll_status(false);
-                sleep(Duration::from_millis(10));
+                sleep(esp.telemetry_interval(Duration::from_millis(10)));
 
                 let gyro_value = map.get("Gyro Value").unwrap();
 
@@ -247,9 +470,10 @@ fn handle_python(
                     };
 
                     while (Instant::now() - start).as_secs() < duration {
+                        esp.keep_link_alive();
                         python_client.send_update_json(esp.poll_status(false));
 
-                        sleep(Duration::from_millis(50));
+                        sleep(esp.telemetry_interval(Duration::from_millis(50)));
                     }
                 } else {
                     println!("error: esp not connected")
@@ -287,6 +511,38 @@ fn handle_ping(esp_container: &mut Option<FranklinClient>) {
     }
 }
 
+/// Handles protocol negotiation command
+///
+/// # Arguments
+/// * `command` - A Vec of arguments
+/// * `esp_container` - A mutable reference to FranklinClient wrapped in Option<>
+///
+/// # Example
+/// `>>> proto 2` Will switch the connection to v2 frames with typed status fields
+fn handle_proto(command: Vec<&str>, esp_container: &mut Option<FranklinClient>) {
+    match esp_container {
+        Some(esp) => {
+            if command.len() != 2 {
+                println!("error: missing arguments");
+                return;
+            }
+
+            let version: u8 = match command[1].parse() {
+                Ok(v) if v >= 1 => v,
+                _ => {
+                    println!("error: invalid argument. expected a protocol version");
+                    return;
+                }
+            };
+
+            esp.negotiate(version);
+        }
+        None => {
+            println!("error: not connected to esp")
+        }
+    }
+}
+
 /// Polls the status of the ESP and displays in an ordered-json format
 ///
 /// # Arguments
@@ -305,16 +561,161 @@ fn handle_poll(esp_container: &mut Option<FranklinClient>) {
     }
 }
 
+/// Estimates the device clock offset
+///
+/// # Arguments
+/// * `esp_container` - A mutable reference to FranklinClient wrapped in Option<>
+///
+/// # Example
+/// `>>> sync` Will run a few time sync exchanges and store the offset
+fn handle_sync(esp_container: &mut Option<FranklinClient>) {
+    match esp_container {
+        Some(esp) => {
+            esp.sync_time();
+        }
+        None => {
+            println!("error: not connected to esp")
+        }
+    }
+}
+
+/// Shows the per-stage latency of the last variable update
+///
+/// # Arguments
+/// * `esp_container` - A mutable reference to FranklinClient wrapped in Option<>
+///
+/// # Example
+/// `>>> trace` Will print the latency breakdown of the last update
+fn handle_trace(esp_container: &mut Option<FranklinClient>) {
+    match esp_container {
+        Some(esp) => {
+            esp.poll_trace();
+        }
+        None => {
+            println!("error: not connected to esp")
+        }
+    }
+}
+
+/// Shows the device's stack, heap and pool usage
+///
+/// # Arguments
+/// * `esp_container` - A mutable reference to FranklinClient wrapped in Option<>
+///
+/// # Example
+/// `>>> mem` Will print the memory statistics
+fn handle_mem(esp_container: &mut Option<FranklinClient>) {
+    match esp_container {
+        Some(esp) => {
+            esp.poll_memory();
+        }
+        None => {
+            println!("error: not connected to esp")
+        }
+    }
+}
+
+/// Shows min, max, mean and RMS of the telemetry since the last summary
+///
+/// # Arguments
+/// * `esp_container` - A mutable reference to FranklinClient wrapped in Option<>
+///
+/// # Example
+/// `>>> summary` Will print the telemetry statistics
+fn handle_summary(esp_container: &mut Option<FranklinClient>) {
+    match esp_container {
+        Some(esp) => {
+            esp.poll_summary();
+        }
+        None => {
+            println!("error: not connected to esp")
+        }
+    }
+}
+
+/// Handles link watchdog command. While armed, the robot stops driving and
+/// then disables its motors if the client goes quiet; the console sends
+/// heartbeats in the background to keep it talking
+///
+/// # Arguments
+/// * `command` - A Vec of arguments
+/// * `esp_container` - A mutable reference to FranklinClient wrapped in Option<>
+///
+/// # Example
+/// `>>> link on` Arms the watchdog
+/// `>>> link off` Disarms the watchdog
+/// `>>> link status` Prints the link state and its recent transitions
+/// `>>> link watch 30` Sends heartbeats for 30 seconds, printing state changes
+fn handle_link(command: Vec<&str>, esp_container: &mut Option<FranklinClient>) {
+    match esp_container {
+        Some(esp) => {
+            if command.len() < 2 {
+                println!("error: missing arguments");
+                return;
+            }
+
+            match command[1] {
+                "on" => esp.arm_link(true),
+                "off" => esp.arm_link(false),
+                "status" => {
+                    esp.poll_link();
+                }
+                "watch" => {
+                    if command.len() != 3 {
+                        println!("error: missing arguments");
+                        return;
+                    }
+
+                    let duration = match command[2].parse::<u64>() {
+                        Ok(val) => val,
+                        Err(_err) => {
+                            println!("error: illegal value {}", command[2]);
+                            return;
+                        }
+                    };
+
+                    let start = Instant::now();
+                    let mut last_state: Option<u8> = None;
+                    while (Instant::now() - start).as_secs() < duration {
+                        let (state, round_trip) = esp.heartbeat();
+                        if last_state != Some(state) {
+                            println!("info: link state {state}, round trip {round_trip} us");
+                            last_state = Some(state);
+                        }
+                        sleep(Duration::from_millis(100));
+                    }
+                    esp.poll_link();
+                }
+                _ => println!("error: invalid argument. expected on/off/status/watch"),
+            }
+        }
+        None => {
+            println!("error: not connected to esp")
+        }
+    }
+}
+
 /// Starts the CLI
 ///
 /// # Arguments
 /// * `esp_container` - A mutable reference to FranklinClient wrapped in Option<>
 /// * `python_addr` - The address of the Python socket server
-pub fn start_console(mut esp_container: Option<FranklinClient>, python_addr: &str) {
+pub fn start_console(esp_container: Option<FranklinClient>, python_addr: &str) {
     println!("\nBeginning Console:\n");
 
     let mut python_container: Option<PythonClient> = None;
 
+    // the console is idle while it waits for input, so heartbeats for an
+    // armed link come from here; commands hold the lock while they run
+    let esp_shared = Arc::new(Mutex::new(esp_container));
+    let esp_keepalive = Arc::clone(&esp_shared);
+    thread::spawn(move || loop {
+        sleep(LINK_KEEPALIVE_CHECK);
+        if let Some(esp) = esp_keepalive.lock().unwrap().as_mut() {
+            esp.keep_link_alive();
+        }
+    });
+
     loop {
         print!(">>> ");
         io::stdout().flush().unwrap();
@@ -326,21 +727,28 @@ pub fn start_console(mut esp_container: Option<FranklinClient>, python_addr: &st
 
         let command_raw: &str = input.trim();
         let command: Vec<&str> = command_raw.split(' ').collect();
+        let mut esp_guard = esp_shared.lock().unwrap();
+        let esp_container = &mut *esp_guard;
 
         // dispatch command
         match command[0] {
-            "pid" => handle_pid(command, &mut esp_container),
-            "mot" => handle_mot(command, &mut esp_container),
-            "gyro" => handle_gyro(command, &mut esp_container),
-            "graph" => handle_graph(command, &mut esp_container),
-            "python" => handle_python(
-                command,
-                &mut esp_container,
-                &mut python_container,
-                python_addr,
-            ),
-            "ping" => handle_ping(&mut esp_container),
-            "poll" => handle_poll(&mut esp_container),
+            "pid" => handle_pid(command, esp_container),
+            "mot" => handle_mot(command, esp_container),
+            "ctrl" => handle_ctrl(command, esp_container),
+            "gyro" => handle_gyro(command, esp_container),
+            "drive" => handle_drive(command, esp_container),
+            "graph" => handle_graph(command, esp_container),
+            "filter" => handle_filter(command, esp_container),
+            "autotune" => handle_autotune(command, esp_container),
+            "python" => handle_python(command, esp_container, &mut python_container, python_addr),
+            "ping" => handle_ping(esp_container),
+            "poll" => handle_poll(esp_container),
+            "proto" => handle_proto(command, esp_container),
+            "sync" => handle_sync(esp_container),
+            "trace" => handle_trace(esp_container),
+            "mem" => handle_mem(esp_container),
+            "summary" => handle_summary(esp_container),
+            "link" => handle_link(command, esp_container),
             "exit" => std::process::exit(0),
             "" => (),
             _ => println!("error: unknown command"),
@@ -11,6 +11,14 @@ pub enum EspOperation {
     Update = 1,
     Ping = 2,
     StatusRequest = 3,
+    Negotiate = 4,
+    TimeSync = 5,
+    LatencyTrace = 6,
+    MemoryStats = 7,
+    AutotuneStatus = 8,
+    TelemetrySummary = 9,
+    Heartbeat = 10,
+    LinkStatus = 11,
 }
 
 /// Maps the different variable target codes that the ESP server expects
@@ -19,8 +27,15 @@ pub enum VariableUpdateTarget {
     PidProportional = 0,
     PidIntegral = 1,
     PidDerivative = 2,
-    // LinearVelocity = 3,
+    LinearVelocity = 3,
     // AngularVelocity = 4,
     MotorEnabled = 5,
     GyroOffset = 6,
+    FilterSelect = 10,
+    FilterType = 11,
+    FilterFrequency = 12,
+    FilterQuality = 13,
+    Autotune = 14,
+    ControllerSelect = 15,
+    LinkWatchdog = 16,
 }
@@ -9,17 +9,312 @@ use std::{
     collections::{HashMap, VecDeque},
     io::{Read, Write},
     net::TcpStream,
-    time::Instant,
+    time::{Duration, Instant},
 };
 
 const HEADER_BYTE: u8 = 0x46;
+const PROTOCOL_V1: u8 = 1;
+const PROTOCOL_V2: u8 = 2;
+const STATUS_FIELDS: [&str; 8] = [
+    "PID Proportional",
+    "PID Integral",
+    "PID Derivative",
+    "Motors Enabled",
+    "Gyro Offset",
+    "Gyro Value",
+    "Integral Sum",
+    "Motor Target",
+];
+const TIME_SYNC_ROUNDS: usize = 8;
+const LINK_STATES: [&str; 4] = ["healthy", "degraded", "hold", "lost"];
+const LINK_CAUSES: [&str; 5] = ["silence", "round trip", "recovered", "armed", "disarmed"];
+// well inside the device's LINK_DEGRADED_SILENCE of 500 ms
+const LINK_HEARTBEAT_INTERVAL: Duration = Duration::from_millis(200);
+// the device's LINK_TELEMETRY_DIVISOR
+const LINK_TELEMETRY_DIVISOR: u32 = 4;
 pub struct FranklinClient {
     socket: TcpStream,
+    epoch: Instant,
+    clock_offset: Option<i64>,
+    last_update_sent: Option<u64>,
+    heartbeat_sequence: u16,
+    last_round_trip: u32,
+    protocol_version: u8,
+    link_armed: bool,
+    link_state: u8,
+    last_heartbeat: Option<Instant>,
 }
+
+/// Computes the CRC-16/CCITT-FALSE that trails a v2 frame
+fn crc16(data: &[u8]) -> u16 {
+    let mut crc: u16 = 0xFFFF;
+    for byte in data {
+        crc ^= (*byte as u16) << 8;
+        for _ in 0..8 {
+            crc = if crc & 0x8000 != 0 {
+                (crc << 1) ^ 0x1021
+            } else {
+                crc << 1
+            };
+        }
+    }
+    crc
+}
+
+/// Appends an unsigned LEB128 varint to a buffer
+fn put_varint(mut value: u32, out: &mut Vec<u8>) {
+    loop {
+        let byte = (value & 0x7F) as u8;
+        value >>= 7;
+        if value == 0 {
+            out.push(byte);
+            return;
+        }
+        out.push(byte | 0x80);
+    }
+}
+
 impl FranklinClient {
     pub fn new(esp_address: &str) -> FranklinClient {
         let socket = TcpStream::connect(esp_address).unwrap();
-        FranklinClient { socket }
+        let mut client = FranklinClient {
+            socket,
+            epoch: Instant::now(),
+            clock_offset: None,
+            last_update_sent: None,
+            heartbeat_sequence: 0,
+            last_round_trip: 0,
+            protocol_version: PROTOCOL_V1,
+            link_armed: false,
+            link_state: 0,
+            last_heartbeat: None,
+        };
+
+        // a device that only speaks v1 answers with v1, and we stay on it
+        client.negotiate(PROTOCOL_V2);
+        client
+    }
+
+    /// Microseconds elapsed on the host clock since the client was created
+    fn host_micros(&self) -> u64 {
+        self.epoch.elapsed().as_micros() as u64
+    }
+
+    /// Frames a request in the negotiated protocol version
+    ///
+    /// # Arguments
+    /// * `operation` - The operation to send
+    /// * `payload` - The request payload; may be empty
+    ///
+    /// # Returns
+    /// * The bytes to write to the socket
+    fn frame(&mut self, operation: EspOperation, payload: &[u8]) -> Vec<u8> {
+        let mut frame: Vec<u8> = Vec::with_capacity(payload.len() + 11);
+
+        if self.protocol_version == PROTOCOL_V2 {
+            frame.extend_from_slice(&[HEADER_BYTE, HEADER_BYTE, PROTOCOL_V2, operation as u8]);
+            put_varint(payload.len() as u32, &mut frame);
+            frame.extend_from_slice(payload);
+
+            // the crc covers everything after the two header bytes
+            let crc = crc16(&frame[2..]);
+            frame.extend_from_slice(&crc.to_be_bytes());
+        } else {
+            let header = self.create_header(operation, payload.len().try_into().unwrap());
+            frame.extend_from_slice(&header);
+            frame.extend_from_slice(payload);
+        }
+
+        frame
+    }
+
+    /// Reads a response frame in the negotiated protocol version
+    ///
+    /// # Returns
+    /// * The response payload
+    fn read_frame(&mut self) -> Vec<u8> {
+        if self.protocol_version != PROTOCOL_V2 {
+            let mut response_header: [u8; 5] = [0; 5];
+            self.socket.read_exact(&mut response_header).unwrap();
+
+            if response_header[0] != HEADER_BYTE || response_header[1] != HEADER_BYTE {
+                panic!("error: invalid response header {:?}", response_header);
+            }
+
+            let length = ((response_header[3] as usize) << 8) | response_header[4] as usize;
+            let mut response: Vec<u8> = vec![0; length];
+            self.socket.read_exact(&mut response).unwrap();
+            return response;
+        }
+
+        let mut header: Vec<u8> = vec![0; 4];
+        self.socket.read_exact(&mut header).unwrap();
+
+        if header[0] != HEADER_BYTE || header[1] != HEADER_BYTE || header[2] != PROTOCOL_V2 {
+            panic!("error: invalid v2 response header {:?}", header);
+        }
+
+        // the payload length is a varint of at most five bytes
+        let mut length: u32 = 0;
+        for shift in (0..35).step_by(7) {
+            let mut byte: [u8; 1] = [0];
+            self.socket.read_exact(&mut byte).unwrap();
+            header.push(byte[0]);
+            length |= ((byte[0] & 0x7F) as u32) << shift;
+            if byte[0] & 0x80 == 0 {
+                break;
+            }
+        }
+
+        let mut response: Vec<u8> = vec![0; length as usize];
+        self.socket.read_exact(&mut response).unwrap();
+        let mut crc_bytes: [u8; 2] = [0; 2];
+        self.socket.read_exact(&mut crc_bytes).unwrap();
+
+        let mut covered = header[2..].to_vec();
+        covered.extend_from_slice(&response);
+        if crc16(&covered) != u16::from_be_bytes(crc_bytes) {
+            panic!(
+                "error: v2 response for operation {} failed its crc",
+                header[3]
+            );
+        }
+
+        response
+    }
+
+    /// Sends a framed request and reads the framed response
+    ///
+    /// # Arguments
+    /// * `operation` - The operation to send
+    /// * `payload` - The request payload; may be empty
+    ///
+    /// # Returns
+    /// * The response payload
+    fn request(&mut self, operation: EspOperation, payload: &[u8]) -> Vec<u8> {
+        let frame = self.frame(operation, payload);
+        self.socket.write_all(&frame).unwrap();
+        self.read_frame()
+    }
+
+    /// Agrees on a protocol version with the device. Every later request is
+    /// framed in the version the device accepts
+    ///
+    /// # Arguments
+    /// * `version` - The highest version to ask for
+    ///
+    /// # Returns
+    /// * The version now in use
+    pub fn negotiate(&mut self, version: u8) -> u8 {
+        let response = self.request(EspOperation::Negotiate, &[version]);
+
+        if response.len() != 1 {
+            panic!("error: negotiate response has {} bytes", response.len());
+        }
+
+        self.protocol_version = match response[0] {
+            PROTOCOL_V2 => PROTOCOL_V2,
+            _ => PROTOCOL_V1,
+        };
+        println!("info: using protocol version {}", self.protocol_version);
+        self.protocol_version
+    }
+
+    /// Estimates the offset between the host and device clocks, NTP style.
+    /// The exchange with the smallest round trip is used, since it has the
+    /// least room for asymmetric delay
+    ///
+    /// # Returns
+    /// * The device clock minus the host clock, in microseconds
+    pub fn sync_time(&mut self) -> i64 {
+        let mut best: Option<(i64, i64)> = None;
+
+        for _ in 0..TIME_SYNC_ROUNDS {
+            let host_send = self.host_micros();
+            let response = self.request(EspOperation::TimeSync, &host_send.to_be_bytes());
+            let host_receive = self.host_micros();
+
+            if response.len() != 24 {
+                println!("error: time sync response has {} bytes", response.len());
+                continue;
+            }
+
+            let echoed = u64::from_be_bytes(response[0..8].try_into().unwrap());
+            let device_receive = u64::from_be_bytes(response[8..16].try_into().unwrap());
+            let device_send = u64::from_be_bytes(response[16..24].try_into().unwrap());
+
+            if echoed != host_send {
+                println!("error: time sync response is for another request");
+                continue;
+            }
+
+            let outbound = device_receive as i64 - host_send as i64;
+            let inbound = device_send as i64 - host_receive as i64;
+            let offset = (outbound + inbound) / 2;
+            let round_trip =
+                (host_receive - host_send) as i64 - (device_send as i64 - device_receive as i64);
+
+            match best {
+                Some((_, best_round_trip)) if best_round_trip <= round_trip => (),
+                _ => best = Some((offset, round_trip)),
+            }
+        }
+
+        let (offset, round_trip) = best.expect("error: every time sync exchange failed");
+        println!("info: device clock offset {offset} us, round trip {round_trip} us");
+        self.clock_offset = Some(offset);
+        offset
+    }
+
+    /// Fetches the stage timestamps of the last variable update to reach the
+    /// motors and prints the latency of each stage
+    ///
+    /// # Returns
+    /// * The device timestamps, in pipeline order
+    pub fn poll_trace(&mut self) -> Vec<u32> {
+        let response = self.request(EspOperation::LatencyTrace, &[]);
+
+        if response.len() != 26 {
+            panic!("error: latency trace response has {} bytes", response.len());
+        }
+
+        let sequence = u16::from_be_bytes([response[0], response[1]]);
+        let stages: Vec<u32> = response[2..]
+            .chunks(4)
+            .map(|chunk| u32::from_be_bytes(chunk.try_into().unwrap()))
+            .collect();
+
+        if sequence == 0 {
+            println!("info: no command has been traced yet");
+            return stages;
+        }
+
+        println!("Latency trace for command {sequence}: {{");
+
+        // the device reports wrapping u32 micros; compare in the same width
+        if let (Some(offset), Some(sent)) = (self.clock_offset, self.last_update_sent) {
+            let sent_device = (sent as i64 + offset) as u32;
+            let uplink = stages[0].wrapping_sub(sent_device) as i32;
+            println!("\tnetwork: {uplink} us");
+        } else {
+            println!("\tnetwork: unknown (run sync first)");
+        }
+
+        let labels = [
+            "socket -> motion queue",
+            "motion queue wait",
+            "control loop",
+            "motor queue wait",
+            "first pulse",
+        ];
+        for (i, label) in labels.iter().enumerate() {
+            let delta = stages[i + 1].wrapping_sub(stages[i]);
+            println!("\t{label}: {delta} us");
+        }
+        println!("\ttotal: {} us", stages[5].wrapping_sub(stages[0]));
+        println!("}}");
+
+        stages
     }
 
     /// Creates a header for a socket message
@@ -40,22 +335,11 @@ impl FranklinClient {
     /// * `message` - The message to send
     pub fn send_message(&mut self, message: String) {
         let message_bytes = message.as_bytes();
-        let header = self.create_header(
-            EspOperation::Message,
-            message_bytes.len().try_into().unwrap(),
-        );
-
-        // concat message
-        let mut write_buf: Vec<u8> = Vec::with_capacity(header.len() + message_bytes.len());
-        write_buf.extend_from_slice(&header);
-        write_buf.extend_from_slice(&message_bytes);
+        let write_buf = self.frame(EspOperation::Message, message_bytes);
 
         self.socket.write(&write_buf).unwrap();
 
-        println!(
-            "debug: sending message -- {:?} + {:?}",
-            &header, &message_bytes
-        );
+        println!("debug: sending message -- {:?}", &write_buf);
     }
 
     /// Pings server and times response
@@ -65,17 +349,18 @@ impl FranklinClient {
     pub fn send_ping(&mut self) -> u128 {
         let start = Instant::now();
         let ping_content = "p i n g g g".as_bytes();
-        let header = self.create_header(EspOperation::Ping, ping_content.len().try_into().unwrap());
-
-        // concat message
-        let mut write_buf: Vec<u8> = Vec::with_capacity(header.len() + ping_content.len());
-        write_buf.extend_from_slice(&header);
-        write_buf.extend_from_slice(&ping_content);
+        let write_buf = self.frame(EspOperation::Ping, ping_content);
 
         self.socket.write(&write_buf).unwrap();
 
-        let mut ping_response: Vec<u8> = vec![0; ping_content.len()];
-        self.socket.read_exact(&mut ping_response).unwrap();
+        // v1 echoes the raw payload; v2 responds with a framed copy
+        let ping_response: Vec<u8> = if self.protocol_version == PROTOCOL_V2 {
+            self.read_frame()
+        } else {
+            let mut raw: Vec<u8> = vec![0; ping_content.len()];
+            self.socket.read_exact(&mut raw).unwrap();
+            raw
+        };
 
         if ping_response.len() != ping_content.len() {
             println!(
@@ -100,6 +385,234 @@ impl FranklinClient {
         elapsed
     }
 
+    /// Fetches the progress of the PID autotuner
+    ///
+    /// # Returns
+    /// * The tuner state (0 idle, 1 running, 2 done, 3 aborted) and a map
+    ///   matching each reported value to its value
+    pub fn poll_autotune(&mut self) -> (u8, HashMap<String, f32>) {
+        let response = self.request(EspOperation::AutotuneStatus, &[]);
+
+        if response.len() != 29 {
+            panic!("error: autotune status response has {} bytes", response.len());
+        }
+
+        let float_at = |i: usize| f32::from_be_bytes(response[i..i + 4].try_into().unwrap());
+        let int_at = |i: usize| f32::from(i16::from_be_bytes([response[i], response[i + 1]]));
+
+        let mut map: HashMap<String, f32> = HashMap::new();
+        map.insert("Abort Reason".to_string(), f32::from(response[1]));
+        map.insert("Cycles".to_string(), f32::from(response[2]));
+        map.insert("Elapsed".to_string(), float_at(3));
+        map.insert("Amplitude".to_string(), float_at(7));
+        map.insert("Period".to_string(), float_at(11));
+        map.insert("Ultimate Gain".to_string(), float_at(15));
+        map.insert("Ultimate Period".to_string(), float_at(19));
+        map.insert("PID Proportional".to_string(), int_at(23));
+        map.insert("PID Integral".to_string(), int_at(25));
+        map.insert("PID Derivative".to_string(), int_at(27));
+
+        (response[0], map)
+    }
+
+    /// Sends a heartbeat to the link watchdog, reporting the round trip of
+    /// the previous one
+    ///
+    /// # Returns
+    /// * The device's link state and this heartbeat's round trip in microseconds
+    pub fn heartbeat(&mut self) -> (u8, u32) {
+        self.heartbeat_sequence = self.heartbeat_sequence.wrapping_add(1);
+
+        let mut payload: Vec<u8> = Vec::with_capacity(6);
+        payload.extend_from_slice(&self.heartbeat_sequence.to_be_bytes());
+        payload.extend_from_slice(&self.last_round_trip.to_be_bytes());
+
+        let start = self.host_micros();
+        let response = self.request(EspOperation::Heartbeat, &payload);
+        let round_trip = (self.host_micros() - start) as u32;
+
+        if response.len() != 3
+            || u16::from_be_bytes([response[0], response[1]]) != self.heartbeat_sequence
+        {
+            panic!("error: invalid heartbeat response {:?}", response);
+        }
+
+        // zero tells the device that no round trip is known
+        self.last_round_trip = round_trip.max(1);
+        self.last_heartbeat = Some(Instant::now());
+        self.link_state = response[2];
+        (response[2], round_trip)
+    }
+
+    /// Arms or disarms the device's link watchdog. While it is armed,
+    /// keep_link_alive must be called regularly
+    ///
+    /// # Arguments
+    /// * `armed` - Whether the watchdog should be armed
+    pub fn arm_link(&mut self, armed: bool) {
+        self.send_update(VariableUpdateTarget::LinkWatchdog, armed as i16);
+        self.link_armed = armed;
+        self.link_state = 0;
+    }
+
+    /// How long to wait between telemetry polls. While the link watchdog
+    /// reports anything worse than healthy, polls are spread out so the
+    /// struggling link carries less traffic
+    ///
+    /// # Arguments
+    /// * `base` - The interval to use on a healthy link
+    pub fn telemetry_interval(&self, base: Duration) -> Duration {
+        if self.link_armed && self.link_state != 0 {
+            base * LINK_TELEMETRY_DIVISOR
+        } else {
+            base
+        }
+    }
+
+    /// Sends a heartbeat if the watchdog is armed and the last one is older
+    /// than LINK_HEARTBEAT_INTERVAL, reporting any change of link state.
+    /// Safe to call as often as convenient
+    pub fn keep_link_alive(&mut self) {
+        if !self.link_armed {
+            return;
+        }
+        if let Some(last) = self.last_heartbeat {
+            if last.elapsed() < LINK_HEARTBEAT_INTERVAL {
+                return;
+            }
+        }
+
+        let previous = self.link_state;
+        let (state, round_trip) = self.heartbeat();
+        if state != previous {
+            let name = LINK_STATES.get(state as usize).unwrap_or(&"unknown");
+            println!("info: link state {name}, round trip {round_trip} us");
+        }
+    }
+
+    /// Fetches and prints the link watchdog's state and its recent
+    /// transitions
+    ///
+    /// # Returns
+    /// * The device's link state
+    pub fn poll_link(&mut self) -> u8 {
+        let response = self.request(EspOperation::LinkStatus, &[]);
+
+        if response.len() < 15 || response.len() != 15 + 7 * response[14] as usize {
+            panic!("error: link status response has {} bytes", response.len());
+        }
+
+        let u32_at = |i: usize| u32::from_be_bytes(response[i..i + 4].try_into().unwrap());
+        let name_of = |state: u8| LINK_STATES.get(state as usize).unwrap_or(&"unknown");
+
+        println!("Link status: {{");
+        println!("\tState: {}", name_of(response[0]));
+        println!("\tArmed: {}", response[1] == 1);
+        println!("\tSilence: {} ms", u32_at(2));
+        println!("\tRound Trip: {} us", u32_at(6));
+        println!("\tTransitions: {}", u32_at(10));
+        for i in 0..response[14] as usize {
+            let base = 15 + i * 7;
+            println!(
+                "\t\t{} ms: {} -> {} ({})",
+                u32_at(base),
+                name_of(response[base + 4]),
+                name_of(response[base + 5]),
+                LINK_CAUSES
+                    .get(response[base + 6] as usize)
+                    .unwrap_or(&"unknown")
+            );
+        }
+        println!("}}");
+
+        response[0]
+    }
+
+    /// Fetches and prints the min, max, mean and RMS of each telemetry field
+    /// over every control-loop sample since the previous summary
+    ///
+    /// # Returns
+    /// * The number of samples, and a map matching each field to its
+    ///   [min, max, mean, rms]
+    pub fn poll_summary(&mut self) -> (u32, HashMap<String, [f32; 4]>) {
+        let response = self.request(EspOperation::TelemetrySummary, &[]);
+
+        if response.len() != 76 {
+            panic!(
+                "error: telemetry summary response has {} bytes",
+                response.len()
+            );
+        }
+
+        let u32_at = |i: usize| u32::from_be_bytes(response[i..i + 4].try_into().unwrap());
+        let float_at = |i: usize| f32::from_be_bytes(response[i..i + 4].try_into().unwrap());
+
+        let start = u32_at(0);
+        let end = u32_at(4);
+        let samples = u32_at(8);
+
+        let labels = ["Tilt", "Tilt Rate", "Motor Target", "Integral Sum"];
+
+        let mut map: HashMap<String, [f32; 4]> = HashMap::new();
+        println!(
+            "Telemetry summary: {samples} samples over {} ms {{",
+            end.wrapping_sub(start) / 1000
+        );
+        for (i, label) in labels.iter().enumerate() {
+            let base = 12 + i * 16;
+            let stats = [
+                float_at(base),
+                float_at(base + 4),
+                float_at(base + 8),
+                float_at(base + 12),
+            ];
+            println!(
+                "\t{label}: min {:.3}, max {:.3}, mean {:.3}, rms {:.3}",
+                stats[0], stats[1], stats[2], stats[3]
+            );
+            map.insert(label.to_string(), stats);
+        }
+        println!("}}");
+
+        (samples, map)
+    }
+
+    /// Fetches and prints the device's memory usage
+    ///
+    /// # Returns
+    /// * A map matching each statistic to its value
+    pub fn poll_memory(&mut self) -> HashMap<String, u32> {
+        let response = self.request(EspOperation::MemoryStats, &[]);
+
+        if response.len() != 40 {
+            panic!("error: memory stats response has {} bytes", response.len());
+        }
+
+        let labels = [
+            "Websocket Stack Free",
+            "Telemetry Stack Free",
+            "Stepper Stack Free",
+            "Heap Free",
+            "Heap Minimum Free",
+            "Heap Largest Block",
+            "Pool Blocks",
+            "Pool In Use",
+            "Pool Peak",
+            "Pool Failures",
+        ];
+
+        let mut map: HashMap<String, u32> = HashMap::new();
+        println!("Memory stats: {{");
+        for (label, chunk) in labels.iter().zip(response.chunks(4)) {
+            let value = u32::from_be_bytes(chunk.try_into().unwrap());
+            println!("\t{label}: {value}");
+            map.insert(label.to_string(), value);
+        }
+        println!("}}");
+
+        map
+    }
+
     /// Polls for telemetry
     ///
     /// # Arguments
@@ -108,12 +621,84 @@ impl FranklinClient {
     /// # Returns
     /// * A map matching variables to their values
     pub fn poll_status(&mut self, show: bool) -> HashMap<String, f32> {
-        let header = self.create_header(EspOperation::StatusRequest, 1);
+        let map = if self.protocol_version == PROTOCOL_V2 {
+            self.poll_status_v2()
+        } else {
+            self.poll_status_v1()
+        };
 
-        // concat message
-        let mut write_buf: Vec<u8> = Vec::with_capacity(header.len() + 1);
-        write_buf.extend_from_slice(&header);
-        write_buf.push(0); // send a random byte so we don't have an empty packet
+        if show {
+            println!("Status response: {{");
+            let mut sorted_pairs: Vec<_> = map.iter().collect();
+            sorted_pairs.sort_by(|a, b| a.0.cmp(b.0));
+            for (key, value) in sorted_pairs {
+                println!("\t{}: {}", key, value);
+            }
+            println!("}}");
+        }
+
+        map
+    }
+
+    /// Requests every status field as typed v2 values
+    ///
+    /// # Returns
+    /// * A map matching variables to their values
+    fn poll_status_v2(&mut self) -> HashMap<String, f32> {
+        let mut mask_bytes: Vec<u8> = Vec::new();
+        put_varint((1 << STATUS_FIELDS.len()) - 1, &mut mask_bytes);
+        let response = self.request(EspOperation::StatusRequest, &mask_bytes);
+
+        let mut mask: u32 = 0;
+        let mut index = 0;
+        for shift in (0..35).step_by(7) {
+            let byte = *response
+                .get(index)
+                .expect("error: status response has no field mask");
+            mask |= ((byte & 0x7F) as u32) << shift;
+            index += 1;
+            if byte & 0x80 == 0 {
+                break;
+            }
+        }
+
+        let mut map: HashMap<String, f32> = HashMap::new();
+        for (field, name) in STATUS_FIELDS.iter().enumerate() {
+            if mask & (1 << field) == 0 {
+                continue;
+            }
+
+            // each value is a type tag then a big-endian value
+            let value = match response.get(index) {
+                Some(1) => {
+                    let bytes = [response[index + 1], response[index + 2]];
+                    index += 3;
+                    f32::from(i16::from_be_bytes(bytes))
+                }
+                Some(2) => {
+                    index += 2;
+                    f32::from(response[index - 1])
+                }
+                Some(3) => {
+                    let bytes = response[index + 1..index + 5].try_into().unwrap();
+                    index += 5;
+                    f32::from_be_bytes(bytes)
+                }
+                _ => panic!("error: invalid type tag for status field {name}"),
+            };
+            map.insert(name.to_string(), value);
+        }
+
+        map
+    }
+
+    /// Requests the status as v1 key/value records
+    ///
+    /// # Returns
+    /// * A map matching variables to their values
+    fn poll_status_v1(&mut self) -> HashMap<String, f32> {
+        // send a random byte so we don't have an empty packet
+        let write_buf = self.frame(EspOperation::StatusRequest, &[0]);
 
         self.socket.write(&write_buf).unwrap();
 
@@ -165,19 +750,7 @@ impl FranklinClient {
             byte_index += 1;
         }
 
-        let map = self.deserialize_status(&mut status_response);
-
-        if show {
-            println!("Status response: {{");
-            let mut sorted_pairs: Vec<_> = map.iter().collect();
-            sorted_pairs.sort_by(|a, b| a.0.cmp(b.0));
-            for (key, value) in sorted_pairs {
-                println!("\t{}: {}", key, value);
-            }
-            println!("}}");
-        }
-
-        map
+        self.deserialize_status(&mut status_response)
     }
 
     /// Deserializes the status response from ESP into a hash map
@@ -245,13 +818,9 @@ impl FranklinClient {
         let b1 = (value >> 8) as u8;
         let b2 = value as u8;
         let payload: [u8; 3] = [target as u8, b1, b2];
-        let header = self.create_header(EspOperation::Update, payload.len().try_into().unwrap());
-
-        // concat message
-        let mut write_buf: Vec<u8> = Vec::with_capacity(header.len() + payload.len());
-        write_buf.extend_from_slice(&header);
-        write_buf.extend_from_slice(&payload);
+        let write_buf = self.frame(EspOperation::Update, &payload);
 
+        self.last_update_sent = Some(self.host_micros());
         self.socket.write(&write_buf).unwrap();
     }
 }